@@ -0,0 +1,250 @@
+#pragma once
+#include "function.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace executor_ {
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+constexpr size_t round_up_to_power_of_two(size_t n) noexcept {
+  size_t result = 1;
+  while (result < n)
+    result <<= 1;
+  return result;
+}
+} // namespace executor_
+
+// bounded lock-free multi-producer multi-consumer queue: every cell carries a
+// sequence number telling producers and consumers whose turn it is, so a push
+// or pop is one CAS on the shared position plus one store to the cell
+template<typename T>
+struct mpmc_queue {
+  explicit mpmc_queue(size_t capacity)
+      : mask(executor_::round_up_to_power_of_two(capacity < 2 ? 2 : capacity) - 1),
+        cells(new cell[mask + 1]) {
+    for (size_t i = 0; i <= mask; ++i)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  mpmc_queue(mpmc_queue const &) = delete;
+  mpmc_queue &operator=(mpmc_queue const &) = delete;
+
+  // nothing else may touch the queue by now, so every cell between the two
+  // positions holds a value
+  ~mpmc_queue() {
+    size_t end = enqueue_pos.load(std::memory_order_relaxed);
+    for (size_t pos = dequeue_pos.load(std::memory_order_relaxed); pos != end;
+         ++pos)
+      cells[pos & mask].value()->~T();
+  }
+
+  // value is left untouched if the queue is full. A T that can't be built
+  // from value without a chance of throwing is built before a cell is
+  // claimed, since a claimed cell has to be filled; value is consumed then
+  // even if the queue turns out to be full.
+  template<typename U>
+  bool try_push(U &&value) {
+    if constexpr (std::is_nothrow_constructible_v<T, U &&>) {
+      return emplace(std::forward<U>(value));
+    } else {
+      static_assert(std::is_nothrow_move_constructible_v<T>,
+                    "T has to be built in the cell without throwing");
+      T built(std::forward<U>(value));
+      return emplace(std::move(built));
+    }
+  }
+
+  bool try_pop(T &out) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell &c = cells[pos & mask];
+      size_t seq = c.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          T *stored = c.value();
+          out = std::move(*stored);
+          stored->~T();
+          c.sequence.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  size_t capacity() const noexcept {
+    return mask + 1;
+  }
+
+ private:
+  template<typename U>
+  bool emplace(U &&value) noexcept {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell &c = cells[pos & mask];
+      size_t seq = c.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          new(&c.storage) T(std::forward<U>(value));
+          c.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  struct cell {
+    // only while the cell holds a value
+    T *value() noexcept {
+      return std::launder(reinterpret_cast<T *>(&storage));
+    }
+
+    std::atomic<size_t> sequence;
+    std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+  };
+
+  size_t const mask;
+  std::unique_ptr<cell[]> cells;
+  alignas(executor_::CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos{0};
+  alignas(executor_::CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos{0};
+};
+
+// fixed-size pool where every worker owns a bounded mpmc_queue of tasks and
+// steals from the other workers' queues when its own runs dry; idle workers
+// sleep until new tasks are submitted
+struct thread_pool {
+  using task = function<void()>;
+
+  explicit thread_pool(size_t threads = std::thread::hardware_concurrency(),
+                       size_t queue_capacity = 1024) {
+    if (threads == 0)
+      threads = 1;
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+      workers.push_back(std::make_unique<worker>(queue_capacity));
+    for (size_t i = 0; i < threads; ++i)
+      workers[i]->thread = std::thread([this, i] { run(i); });
+  }
+
+  thread_pool(thread_pool const &) = delete;
+  thread_pool &operator=(thread_pool const &) = delete;
+
+  // runs every task submitted so far, then joins the workers
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stopping.store(true);
+    }
+    wake_up.notify_all();
+    for (auto &w : workers)
+      w->thread.join();
+  }
+
+  // tasks submitted from a worker go to its own queue, others are spread
+  // round-robin; when every queue is full a worker runs the task itself and
+  // an outside thread waits for room. A task must not throw.
+  template<typename F>
+  void submit(F f) {
+    task t(std::move(f));
+    pending.fetch_add(1);
+
+    size_t start = current_pool == this
+                       ? current_worker
+                       : next_worker.fetch_add(1, std::memory_order_relaxed);
+    while (!push_somewhere(t, start)) {
+      if (current_pool == this) {
+        pending.fetch_sub(1);
+        t();
+        return;
+      }
+      std::this_thread::yield();
+    }
+
+    if (sleeping.load() != 0) {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      wake_up.notify_one();
+    }
+  }
+
+  size_t size() const noexcept {
+    return workers.size();
+  }
+
+ private:
+  struct worker {
+    explicit worker(size_t queue_capacity) : tasks(queue_capacity) {}
+
+    mpmc_queue<task> tasks;
+    std::thread thread;
+  };
+
+  bool push_somewhere(task &t, size_t start) {
+    for (size_t i = 0; i < workers.size(); ++i) {
+      if (workers[(start + i) % workers.size()]->tasks.try_push(std::move(t)))
+        return true;
+    }
+    return false;
+  }
+
+  bool take(size_t self, task &t) {
+    for (size_t i = 0; i < workers.size(); ++i) {
+      if (workers[(self + i) % workers.size()]->tasks.try_pop(t)) {
+        pending.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(size_t self) {
+    current_pool = this;
+    current_worker = self;
+    task t;
+    for (;;) {
+      if (take(self, t)) {
+        t();
+        t = task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleeping.fetch_add(1);
+      wake_up.wait(lock, [this] {
+        return pending.load() != 0 || stopping.load();
+      });
+      sleeping.fetch_sub(1);
+      if (stopping.load() && pending.load() == 0)
+        return;
+    }
+  }
+
+  static inline thread_local thread_pool *current_pool = nullptr;
+  static inline thread_local size_t current_worker = 0;
+
+  std::vector<std::unique_ptr<worker>> workers;
+  alignas(executor_::CACHE_LINE_SIZE) std::atomic<size_t> pending{0};
+  alignas(executor_::CACHE_LINE_SIZE) std::atomic<size_t> next_worker{0};
+  std::atomic<size_t> sleeping{0};
+  std::atomic<bool> stopping{false};
+  std::mutex sleep_mutex;
+  std::condition_variable wake_up;
+};
@@ -0,0 +1,62 @@
+#include "executor.h"
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// every benchmark thread pushes and then pops one task, so the queue stays
+// shallow and all threads contend on both ends
+void bm_mpmc_queue_push_pop(benchmark::State &state) {
+  static std::unique_ptr<mpmc_queue<function<void()>>> queue;
+  if (state.thread_index() == 0)
+    queue = std::make_unique<mpmc_queue<function<void()>>>(1024);
+
+  function<void()> out;
+  for (auto _ : state) {
+    while (!queue->try_push([] {}))
+      std::this_thread::yield();
+    while (!queue->try_pop(out))
+      std::this_thread::yield();
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0)
+    queue.reset();
+}
+BENCHMARK(bm_mpmc_queue_push_pop)->ThreadRange(1, 64)->UseRealTime();
+
+// submits a batch of trivial tasks and waits for the pool to run them all
+void bm_thread_pool_throughput(benchmark::State &state) {
+  constexpr size_t batch = 10000;
+  thread_pool pool(state.range(0));
+  std::atomic<size_t> done{0};
+
+  for (auto _ : state) {
+    done.store(0);
+    for (size_t i = 0; i < batch; ++i)
+      pool.submit([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+    while (done.load() != batch)
+      std::this_thread::yield();
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(bm_thread_pool_throughput)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+
+// time from submitting a task until it starts running on an idle pool
+void bm_thread_pool_latency(benchmark::State &state) {
+  thread_pool pool(state.range(0));
+  std::atomic<bool> ran{false};
+
+  for (auto _ : state) {
+    ran.store(false);
+    pool.submit([&ran] { ran.store(true); });
+    while (!ran.load())
+      std::this_thread::yield();
+  }
+}
+BENCHMARK(bm_thread_pool_latency)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+
+} // namespace
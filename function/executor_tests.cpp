@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include "executor.h"
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(mpmc_queue_test, fifo)
+{
+    mpmc_queue<int> q(4);
+    EXPECT_EQ(4, q.capacity());
+    for (int i = 0; i < 4; ++i)
+        EXPECT_TRUE(q.try_push(i));
+    for (int i = 0; i < 4; ++i)
+    {
+        int value = -1;
+        EXPECT_TRUE(q.try_pop(value));
+        EXPECT_EQ(i, value);
+    }
+    int value;
+    EXPECT_FALSE(q.try_pop(value));
+}
+
+TEST(mpmc_queue_test, capacity_rounded_up)
+{
+    mpmc_queue<int> q(5);
+    EXPECT_EQ(8, q.capacity());
+}
+
+TEST(mpmc_queue_test, full_keeps_value)
+{
+    mpmc_queue<std::unique_ptr<int>> q(2);
+    EXPECT_TRUE(q.try_push(std::make_unique<int>(1)));
+    EXPECT_TRUE(q.try_push(std::make_unique<int>(2)));
+    auto p = std::make_unique<int>(3);
+    EXPECT_FALSE(q.try_push(std::move(p)));
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(3, *p);
+}
+
+TEST(mpmc_queue_test, destroys_remaining)
+{
+    auto shared = std::make_shared<int>(42);
+    {
+        mpmc_queue<std::shared_ptr<int>> q(8);
+        q.try_push(shared);
+        q.try_push(shared);
+        EXPECT_EQ(3, shared.use_count());
+    }
+    EXPECT_EQ(1, shared.use_count());
+}
+
+namespace
+{
+// no default constructor, and building one from a negative number throws
+struct picky
+{
+    explicit picky(int value)
+        : value(value)
+    {
+        if (value < 0)
+            throw std::invalid_argument("negative");
+    }
+
+    int value;
+};
+}
+
+TEST(mpmc_queue_test, throwing_construction_leaves_no_hole)
+{
+    mpmc_queue<picky> q(2);
+    EXPECT_THROW(q.try_push(-1), std::invalid_argument);
+    EXPECT_TRUE(q.try_push(1));
+    EXPECT_TRUE(q.try_push(2));
+    picky out(0);
+    EXPECT_TRUE(q.try_pop(out));
+    EXPECT_EQ(1, out.value);
+    EXPECT_TRUE(q.try_push(3));
+}
+
+TEST(mpmc_queue_test, functions)
+{
+    mpmc_queue<function<int ()>> q(2);
+    EXPECT_TRUE(q.try_push([] { return 42; }));
+    function<int ()> f;
+    EXPECT_TRUE(q.try_pop(f));
+    EXPECT_EQ(42, f());
+}
+
+TEST(mpmc_queue_test, concurrent)
+{
+    constexpr size_t threads = 4;
+    constexpr size_t per_thread = 10000;
+    mpmc_queue<size_t> q(64);
+    std::atomic<size_t> consumed{0};
+    std::atomic<size_t> sum{0};
+
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        pool.emplace_back([&, t] {
+            for (size_t i = 0; i < per_thread; ++i)
+                while (!q.try_push(t * per_thread + i))
+                    std::this_thread::yield();
+        });
+        pool.emplace_back([&] {
+            size_t value;
+            while (consumed.load() < threads * per_thread)
+            {
+                if (q.try_pop(value))
+                {
+                    sum.fetch_add(value);
+                    consumed.fetch_add(1);
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& t : pool)
+        t.join();
+
+    size_t n = threads * per_thread;
+    EXPECT_EQ(n * (n - 1) / 2, sum.load());
+}
+
+TEST(thread_pool_test, runs_all_tasks)
+{
+    std::atomic<size_t> done{0};
+    {
+        thread_pool pool(4, 16);
+        for (size_t i = 0; i < 1000; ++i)
+            pool.submit([&done] { done.fetch_add(1); });
+    }
+    EXPECT_EQ(1000, done.load());
+}
+
+TEST(thread_pool_test, single_worker)
+{
+    std::vector<int> order;
+    {
+        thread_pool pool(1, 8);
+        for (int i = 0; i < 100; ++i)
+            pool.submit([&order, i] { order.push_back(i); });
+    }
+    ASSERT_EQ(100, order.size());
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(i, order[i]);
+}
+
+TEST(thread_pool_test, nested_submit)
+{
+    std::atomic<size_t> done{0};
+    {
+        thread_pool pool(3, 4);
+        for (size_t i = 0; i < 50; ++i)
+        {
+            pool.submit([&pool, &done] {
+                for (size_t j = 0; j < 10; ++j)
+                    pool.submit([&done] { done.fetch_add(1); });
+                done.fetch_add(1);
+            });
+        }
+    }
+    EXPECT_EQ(550, done.load());
+}
+
+TEST(thread_pool_test, large_tasks)
+{
+    std::atomic<size_t> sum{0};
+    {
+        thread_pool pool(2);
+        for (size_t i = 0; i < 100; ++i)
+        {
+            std::vector<size_t> payload(100, i);
+            pool.submit([&sum, payload = std::move(payload)] {
+                for (size_t x : payload)
+                    sum.fetch_add(x);
+            });
+        }
+    }
+    EXPECT_EQ(100 * (99 * 100 / 2), sum.load());
+}
@@ -1,4 +1,7 @@
 #pragma once
+#include <functional>
+#include <memory>
+#include <memory_resource>
 #include <type_traits>
 
 struct bad_function_call : std::exception {
@@ -8,150 +11,246 @@ struct bad_function_call : std::exception {
 };
 
 namespace functional_ {
-static constexpr size_t MAX_SIZE_OF = sizeof(void *);
 static constexpr size_t MAX_ALIGN_OF = alignof(void *);
 
+// the buffer fits an object pointer next to a member function pointer (two
+// words on the Itanium ABI), and so a lambda with three captured pointers
+static constexpr size_t BUFFER_SIZE_OF = 3 * sizeof(void *);
+
+template<auto Method, typename T>
+struct static_member_binding;
+
+template<typename T, typename Method>
+struct member_binding;
+
+// anything that fits the buffer and can't throw while being moved is kept
+// inline; this includes function pointers, member pointers and bind_member
+// results
 template<typename T>
 static constexpr bool is_small_obj =
-    sizeof(T) < MAX_SIZE_OF
-        && std::is_nothrow_move_constructible_v<T>; // alignof(T) < MAX_ALIGN_OF is true if sizeof(T) < MAX_SIZE_OF
+    sizeof(T) <= BUFFER_SIZE_OF && alignof(T) <= MAX_ALIGN_OF
+        && std::is_nothrow_move_constructible_v<T>;
 
-using st_type = std::aligned_storage_t<sizeof(void *), alignof(void *)>;
+using st_type = std::aligned_storage_t<BUFFER_SIZE_OF, MAX_ALIGN_OF>;
 
-template<typename R, typename... Args>
+template<typename... Signatures>
 struct storage;
 
-template<typename R, typename... Args>
-struct operations_interface {
-  using storage = functional_::storage<R, Args...>;
+template<typename Storage, typename Signature>
+struct apply_entry;
 
-  void (*copy)(storage *, storage const *);
-  void (*move)(storage *, storage *) noexcept;
-  R (*apply)(storage const *, Args...);
-  void (*destroy)(storage *);
+// one apply per signature; arguments cross the type-erasure boundary by
+// reference, so a by-value parameter is moved into the callable once instead
+// of once per hop
+template<typename Storage, typename R, typename... Args>
+struct apply_entry<Storage, R(Args...)> {
+  R (*apply)(Storage const *, Args &&...);
 };
 
-template<typename R, typename... Args>
-operations_interface<R, Args...> const *get_empty_type_operations() {
-  using storage = functional_::storage<R, Args...>;
-  static constexpr operations_interface<R, Args...> operations = {
-      /* copy */
-      [](storage *dst, storage const *) {
-        dst->ops = get_empty_type_operations<R, Args...>();
-      },
-      /* move */
-      [](storage *dst, storage *) noexcept {
-        dst->ops = get_empty_type_operations<R, Args...>();
-      },
-      /* apply */
-      [](storage const *, Args...) -> R {
-        throw bad_function_call();
-      },
-      /* destroy */
-      [](storage *) {}
-  };
-  return &operations;
-}
+template<typename Storage>
+struct lifetime_operations {
+  void (*copy)(Storage *, Storage const *);
+  void (*move)(Storage *, Storage *) noexcept;
+  void (*destroy)(Storage *);
+};
 
-template<typename F, typename = void>
-struct object_traits;
+template<typename... Signatures>
+struct operations_interface
+    : lifetime_operations<storage<Signatures...>>,
+      apply_entry<storage<Signatures...>, Signatures>... {
+  using storage = functional_::storage<Signatures...>;
 
-template<typename F>
-struct object_traits<F, std::enable_if_t<is_small_obj<F>>> {
+  template<typename Signature>
+  apply_entry<storage, Signature> const &entry() const noexcept {
+    return *this;
+  }
+};
+
+template<typename Storage, typename Signature>
+struct empty_invoker;
 
-  template<typename R, typename... Args>
-  static operations_interface<R, Args...> const *get_operations() {
+template<typename Storage, typename R, typename... Args>
+struct empty_invoker<Storage, R(Args...)> {
+  static R apply(Storage const *, Args &&...) {
+    throw bad_function_call();
+  }
+};
 
-    using storage = functional_::storage<R, Args...>;
+template<typename Traits, typename Storage, typename Signature>
+struct invoker;
+
+template<typename Traits, typename Storage, typename R, typename... Args>
+struct invoker<Traits, Storage, R(Args...)> {
+  static R apply(Storage const *st, Args &&...args) {
+    // std::invoke so that member pointers are callable with the object as
+    // the first argument
+    if constexpr (std::is_void_v<R>) {
+      std::invoke(Traits::object(*st), std::forward<Args>(args)...);
+    } else {
+      return std::invoke(Traits::object(*st), std::forward<Args>(args)...);
+    }
+  }
+};
 
-    static constexpr operations_interface<R, Args...> operations = {
+// a single object per signature set, so checking for emptiness is a pointer
+// compare against a link-time constant
+template<typename... Signatures>
+inline constexpr operations_interface<Signatures...> empty_operations = {
+    {
         /* copy */
-        [](storage *dst, storage const *src) {
-          new(&dst->small) F(src->template get_obj<F>());
-          dst->ops = src->ops;
+        [](storage<Signatures...> *dst, storage<Signatures...> const *) {
+          dst->ops = &empty_operations<Signatures...>;
         },
         /* move */
-        [](storage *dst, storage *src) noexcept {
-          new(&dst->small) F(std::move(src->template get_obj<F>()));
-          dst->ops = src->ops;
-        },
-        /* apply */
-        [](storage const *dst, Args... args) -> R {
-          return (dst->template get_obj<F>())(std::forward<Args>(args)...);
+        [](storage<Signatures...> *dst, storage<Signatures...> *) noexcept {
+          dst->ops = &empty_operations<Signatures...>;
         },
         /* destroy */
-        [](storage *dst) {
-          dst->template get_obj<F>().~F();
-        }
+        [](storage<Signatures...> *) {}
+    },
+    /* apply */
+    {&empty_invoker<storage<Signatures...>, Signatures>::apply}...
+};
+
+template<typename F, typename = void>
+struct object_traits;
+
+template<typename F>
+struct object_traits<F, std::enable_if_t<is_small_obj<F>>> {
+
+  template<typename... Signatures>
+  static operations_interface<Signatures...> const *get_operations() {
+
+    using storage = functional_::storage<Signatures...>;
+
+    static constexpr operations_interface<Signatures...> operations = {
+        {
+            /* copy */
+            [](storage *dst, storage const *src) {
+              new(&dst->small) F(src->template get_obj<F>());
+              dst->ops = src->ops;
+            },
+            /* move */
+            [](storage *dst, storage *src) noexcept {
+              new(&dst->small) F(std::move(src->template get_obj<F>()));
+              dst->ops = src->ops;
+            },
+            /* destroy */
+            [](storage *dst) {
+              dst->template get_obj<F>().~F();
+            }
+        },
+        /* apply */
+        {&invoker<object_traits, storage, Signatures>::apply}...
     };
     return &operations;
   }
 
-  template<typename R, typename... Args>
-  static void init(storage<R, Args...> &storage, F &&func) {
+  template<typename... Signatures>
+  static void init(storage<Signatures...> &storage, F &&func,
+                   std::pmr::memory_resource *) {
     new(&storage.small) F(std::move(func));
   }
 
-  template<typename R, typename... Args>
-  static F *target(storage<R, Args...> &st) noexcept {
+  template<typename... Signatures>
+  static F const &object(storage<Signatures...> const &st) noexcept {
+    return st.template get_obj<F>();
+  }
+
+  template<typename... Signatures>
+  static F *target(storage<Signatures...> &st) noexcept {
     return &(st.template get_obj<F>());
   }
 
-  template<typename R, typename... Args>
-  static F const *target(storage<R, Args...> const &st) noexcept {
+  template<typename... Signatures>
+  static F const *target(storage<Signatures...> const &st) noexcept {
     return &(st.template get_obj<F>());
   }
 };
 
+// large callables live on the heap next to the resource they were allocated
+// from, so copies and destruction go back to the same resource
 template<typename F>
-struct object_traits<F, std::enable_if_t<!is_small_obj<F>>> {
-
-  template<typename R, typename... Args>
-  static operations_interface<R, Args...> const *get_operations() {
+struct heap_box {
+  std::pmr::memory_resource *resource;
+  F obj;
+
+  template<typename... CtorArgs>
+  static heap_box *create(std::pmr::memory_resource *resource,
+                          CtorArgs &&...ctor_args) {
+    void *mem = resource->allocate(sizeof(heap_box), alignof(heap_box));
+    try {
+      return new(mem) heap_box{resource, F(std::forward<CtorArgs>(ctor_args)...)};
+    } catch (...) {
+      resource->deallocate(mem, sizeof(heap_box), alignof(heap_box));
+      throw;
+    }
+  }
 
-    using storage = functional_::storage<R, Args...>;
+  static void destroy(heap_box *box) {
+    std::pmr::memory_resource *resource = box->resource;
+    box->~heap_box();
+    resource->deallocate(box, sizeof(heap_box), alignof(heap_box));
+  }
+};
 
-    static constexpr operations_interface<R, Args...> operations = {
-        /* copy */
-        [](storage *dst, storage const *src) {
-          dst->ops = src->ops;
-          dst->set(new F(*src->template get<F>()));
-        },
-        /* move */
-        [](storage *dst, storage *src) noexcept {
-          dst->ops = src->ops;
-          dst->set((void *) src->template get<F>());
-          src->ops = get_empty_type_operations<R, Args...>();
+template<typename F>
+struct object_traits<F, std::enable_if_t<!is_small_obj<F>>> {
+  using box = heap_box<F>;
+
+  template<typename... Signatures>
+  static operations_interface<Signatures...> const *get_operations() {
+
+    using storage = functional_::storage<Signatures...>;
+
+    static constexpr operations_interface<Signatures...> operations = {
+        {
+            /* copy */
+            [](storage *dst, storage const *src) {
+              box const *src_box = src->template get<box>();
+              dst->set(box::create(src_box->resource, src_box->obj));
+              dst->ops = src->ops;
+            },
+            /* move */
+            [](storage *dst, storage *src) noexcept {
+              dst->ops = src->ops;
+              dst->set((void *) src->template get<box>());
+              src->ops = &empty_operations<Signatures...>;
+            },
+            /* destroy */
+            [](storage *dst) {
+              box::destroy(dst->template get<box>());
+            }
         },
         /* apply */
-        [](storage const *dst, Args... args) -> R {
-          return (*dst->template get<F>())(std::forward<Args...>(args)...);
-        },
-        /* destroy */
-        [](storage *dst) {
-          delete dst->template get<F>();
-        }
+        {&invoker<object_traits, storage, Signatures>::apply}...
     };
     return &operations;
   }
 
-  template<typename R, typename... Args>
-  static void init(storage<R, Args...> &storage, F &&func) {
-    storage.set(new F(std::move(func)));
+  template<typename... Signatures>
+  static void init(storage<Signatures...> &storage, F &&func,
+                   std::pmr::memory_resource *resource) {
+    storage.set(box::create(resource, std::move(func)));
   }
 
-  template<typename R, typename... Args>
-  static F *target(storage<R, Args...> &st) noexcept {
-    return st.template get<F>();
+  template<typename... Signatures>
+  static F const &object(storage<Signatures...> const &st) noexcept {
+    return st.template get<box>()->obj;
   }
 
-  template<typename R, typename... Args>
-  static F const *target(storage<R, Args...> const &st) noexcept {
-    return st.template get<F>();
+  template<typename... Signatures>
+  static F *target(storage<Signatures...> &st) noexcept {
+    return &st.template get<box>()->obj;
+  }
+
+  template<typename... Signatures>
+  static F const *target(storage<Signatures...> const &st) noexcept {
+    return &st.template get<box>()->obj;
   }
 };
 
-template<typename R, typename... Args>
+template<typename... Signatures>
 struct storage {
   template<typename F>
   F *get() const noexcept {
@@ -172,18 +271,104 @@ struct storage {
     reinterpret_cast<void *&>(small) = t;
   }
 
-  operations_interface<R, Args...> const *ops;
+  operations_interface<Signatures...> const *ops;
   st_type small;
 };
+
+template<typename F, typename Signature>
+struct is_callable_as;
+
+template<typename F, typename R, typename... Args>
+struct is_callable_as<F, R(Args...)>
+    : std::is_invocable_r<R, F const &, Args...> {};
+
+template<typename F, typename... Signatures>
+bool holds(storage<Signatures...> const &st) noexcept {
+  // a type that can't serve every signature was never stored, and asking for
+  // its operations would not compile
+  if constexpr ((is_callable_as<F, Signatures>::value && ...))
+    return st.ops == object_traits<F>::template get_operations<Signatures...>();
+  else
+    return false;
+}
+
+// adds the call operator for one signature to function<Signatures...>
+template<typename Function, typename Signature>
+struct invocation;
+
+template<typename Function, typename R, typename... Args>
+struct invocation<Function, R(Args...)> {
+  R operator()(Args... args) const {
+    auto const &st = static_cast<Function const *>(this)->storage;
+    return st.ops->template entry<R(Args...)>().apply(
+        &st, std::forward<Args>(args)...);
+  }
+
+  // when F is stored, calls its trampoline directly so the call can be
+  // inlined; otherwise behaves like operator()
+  template<typename F>
+  R invoke_as(Args... args) const {
+    static_assert(is_callable_as<F, R(Args...)>::value,
+                  "F can't be called with this signature");
+    using storage = std::remove_reference_t<
+        decltype(static_cast<Function const *>(this)->storage)>;
+
+    auto const &st = static_cast<Function const *>(this)->storage;
+    if (holds<F>(st))
+      return invoker<object_traits<F>, storage, R(Args...)>::apply(
+          &st, std::forward<Args>(args)...);
+    return st.ops->template entry<R(Args...)>().apply(
+        &st, std::forward<Args>(args)...);
+  }
+};
+
+template<auto Method, typename T>
+struct static_member_binding {
+  T *obj;
+
+  template<typename... CallArgs>
+  decltype(auto) operator()(CallArgs &&...args) const {
+    return std::invoke(Method, obj, std::forward<CallArgs>(args)...);
+  }
+};
+
+template<typename T, typename Method>
+struct member_binding {
+  T *obj;
+  Method method;
+
+  template<typename... CallArgs>
+  decltype(auto) operator()(CallArgs &&...args) const {
+    return std::invoke(method, obj, std::forward<CallArgs>(args)...);
+  }
+};
 } // namespace functional_
 
-template<typename F>
-struct function;
+// binds a member function to an object without allocating: the first form
+// keeps the method in the type and stores just the object pointer
+template<auto Method, typename T>
+functional_::static_member_binding<Method, T> bind_member(T *obj) noexcept {
+  static_assert(std::is_member_function_pointer_v<decltype(Method)>);
+  return {obj};
+}
+
+template<typename T, typename Method>
+functional_::member_binding<T, Method> bind_member(T *obj,
+                                                   Method method) noexcept {
+  static_assert(std::is_member_function_pointer_v<Method>);
+  return {obj, method};
+}
+
+// function<R(Args...)> is the usual single-signature wrapper; listing several
+// signatures stores the callable once and overloads operator() for each
+template<typename... Signatures>
+struct function
+    : functional_::invocation<function<Signatures...>, Signatures>... {
+  static_assert(sizeof...(Signatures) > 0,
+                "function needs at least one signature");
 
-template<typename R, typename... Args>
-struct function<R(Args...)> {
   function() noexcept {
-    storage.ops = functional_::get_empty_type_operations<R, Args...>();
+    storage.ops = &functional_::empty_operations<Signatures...>;
   };
 
   function(function const &other) {
@@ -195,10 +380,17 @@ struct function<R(Args...)> {
   }
 
   template<typename F>
-  function(F f) {
+  function(F f)
+      : function(std::allocator_arg, std::pmr::get_default_resource(),
+                 std::move(f)) {}
+
+  // callables that don't fit the small buffer are allocated from resource;
+  // copies of this function allocate from the same resource
+  template<typename F>
+  function(std::allocator_arg_t, std::pmr::memory_resource *resource, F f) {
     using traits = functional_::object_traits<F>;
-    traits::template init<R, Args...>(storage, std::move(f));
-    storage.ops = traits::template get_operations<R, Args...>();
+    traits::template init<Signatures...>(storage, std::move(f), resource);
+    storage.ops = traits::template get_operations<Signatures...>();
   }
 
   function &operator=(function const &rhs) {
@@ -220,37 +412,68 @@ struct function<R(Args...)> {
   }
 
   explicit operator bool() const noexcept {
-    return storage.ops != functional_::get_empty_type_operations<R, Args...>();
+    return storage.ops != &functional_::empty_operations<Signatures...>;
   }
 
-  R operator()(Args... args) const {
-    return storage.ops->apply(&storage, std::forward<Args>(args)...);
-  }
+  using functional_::invocation<function, Signatures>::operator()...;
+  using functional_::invocation<function, Signatures>::invoke_as...;
 
   template<typename T>
   T *target() noexcept {
-    using traits = functional_::object_traits<T>;
-
-    if (storage.ops == traits::template get_operations<R, Args...>())
-      return traits::template target(storage);
+    if (functional_::holds<T>(storage))
+      return functional_::object_traits<T>::target(storage);
     else
       return nullptr;
   }
 
   template<typename T>
   T const *target() const noexcept {
-    using traits = functional_::object_traits<T>;
-
-    if (storage.ops == traits::template get_operations<R, Args...>())
-      return traits::template target(storage);
+    if (functional_::holds<T>(storage))
+      return functional_::object_traits<T>::target(storage);
     else
       return nullptr;
   }
 
-  void swap(function &other) {
-    std::swap(storage, other.storage);
+  // calls visitor with the stored F and returns true, or returns false
+  // without calling it if something else is stored
+  template<typename F, typename Visitor>
+  bool visit_as(Visitor &&visitor) {
+    if (F *f = target<F>()) {
+      std::forward<Visitor>(visitor)(*f);
+      return true;
+    }
+    return false;
+  }
+
+  template<typename F, typename Visitor>
+  bool visit_as(Visitor &&visitor) const {
+    if (F const *f = target<F>()) {
+      std::forward<Visitor>(visitor)(*f);
+      return true;
+    }
+    return false;
+  }
+
+  // inline objects may point into themselves, so they are moved with their
+  // own move constructor rather than copied bytewise
+  void swap(function &other) noexcept {
+    if (&other == this)
+      return;
+    functional_::storage<Signatures...> tmp;
+    relocate(&tmp, &storage);
+    relocate(&storage, &other.storage);
+    relocate(&other.storage, &tmp);
   }
 
  private:
-  functional_::storage<R, Args...> storage;
+  template<typename, typename>
+  friend struct functional_::invocation;
+
+  static void relocate(functional_::storage<Signatures...> *dst,
+                       functional_::storage<Signatures...> *src) noexcept {
+    src->ops->move(dst, src);
+    src->ops->destroy(src);
+  }
+
+  functional_::storage<Signatures...> storage;
 };
@@ -0,0 +1,287 @@
+#include "function.h"
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace {
+std::atomic<size_t> allocations{0};
+} // namespace
+
+// g++ inlines the replacements into their callers at -O2 and then warns that
+// free() releases memory from operator new; kept out of line, they are seen
+// as a plain malloc/free pair
+#ifdef _MSC_VER
+#define REPLACEMENT_NOINLINE __declspec(noinline)
+#else
+#define REPLACEMENT_NOINLINE __attribute__((noinline))
+#endif
+
+REPLACEMENT_NOINLINE void *operator new(size_t count) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(count == 0 ? 1 : count))
+    return p;
+  throw std::bad_alloc();
+}
+
+REPLACEMENT_NOINLINE void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+REPLACEMENT_NOINLINE void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+// std::pmr::new_delete_resource() allocates through the aligned overloads
+REPLACEMENT_NOINLINE void *operator new(size_t count, std::align_val_t align) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  size_t alignment = static_cast<size_t>(align);
+  size_t size = (count + alignment - 1) / alignment * alignment;
+  if (void *p = std::aligned_alloc(alignment, size == 0 ? alignment : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+REPLACEMENT_NOINLINE void operator delete(void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+REPLACEMENT_NOINLINE void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+struct small_callable {
+  int value;
+
+  int operator()(int x) const {
+    return value + x;
+  }
+};
+static_assert(functional_::is_small_obj<small_callable>);
+
+struct large_callable {
+  int value;
+  std::array<int, 16> payload{};
+
+  int operator()(int x) const {
+    return value + x + payload[0];
+  }
+};
+static_assert(!functional_::is_small_obj<large_callable>);
+
+int free_function(int x) {
+  return x + 1;
+}
+
+struct holder {
+  int value;
+
+  int get(int x) const {
+    return value + x;
+  }
+};
+
+// each benchmark reports ns/op through the usual time columns and the
+// number of global allocations per iteration as allocs/op
+struct allocation_counter {
+  explicit allocation_counter(benchmark::State &state)
+      : state(state), before(allocations.load(std::memory_order_relaxed)) {}
+
+  ~allocation_counter() {
+    size_t after = allocations.load(std::memory_order_relaxed);
+    state.counters["allocs/op"] = benchmark::Counter(
+        static_cast<double>(after - before),
+        benchmark::Counter::kAvgIterations);
+  }
+
+  benchmark::State &state;
+  size_t before;
+};
+
+template<typename Function>
+Function make_empty() {
+  return Function();
+}
+
+template<typename Function>
+Function make_small() {
+  return small_callable{1};
+}
+
+template<typename Function>
+Function make_large() {
+  return large_callable{1};
+}
+
+template<typename Function>
+Function make_function_pointer() {
+  return &free_function;
+}
+
+template<typename Function>
+Function make_member_pointer() {
+  return &holder::get;
+}
+
+template<typename Function, Function (*make)()>
+void bm_construct(benchmark::State &state) {
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    Function f = make();
+    benchmark::DoNotOptimize(f);
+  }
+}
+
+template<typename Function, Function (*make)()>
+void bm_copy(benchmark::State &state) {
+  Function f = make();
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    Function g = f;
+    benchmark::DoNotOptimize(g);
+  }
+}
+
+// moves there and back, so one iteration is two moves
+template<typename Function, Function (*make)()>
+void bm_move(benchmark::State &state) {
+  Function f = make();
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    Function g = std::move(f);
+    benchmark::DoNotOptimize(g);
+    f = std::move(g);
+  }
+}
+
+template<typename Function, Function (*make)()>
+void bm_call(benchmark::State &state) {
+  Function f = make();
+  int x = 0;
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(x = f(x));
+  }
+}
+
+template<typename Function, Function (*make)()>
+void bm_call_member(benchmark::State &state) {
+  Function f = make();
+  holder h{1};
+  int x = 0;
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(x = f(h, x));
+  }
+}
+
+using ours = function<int(int)>;
+using std_function = std::function<int(int)>;
+using ours_member = function<int(holder const &, int)>;
+using std_member = std::function<int(holder const &, int)>;
+
+#define FUNCTION_BENCHMARKS(bm, kind)                                          \
+  BENCHMARK_TEMPLATE(bm, ours, make_##kind<ours>)->Name(#bm "/" #kind "/function"); \
+  BENCHMARK_TEMPLATE(bm, std_function, make_##kind<std_function>)              \
+      ->Name(#bm "/" #kind "/std::function")
+
+#define LIFETIME_BENCHMARKS(kind)                                              \
+  FUNCTION_BENCHMARKS(bm_construct, kind);                                     \
+  FUNCTION_BENCHMARKS(bm_copy, kind);                                          \
+  FUNCTION_BENCHMARKS(bm_move, kind)
+
+LIFETIME_BENCHMARKS(empty);
+LIFETIME_BENCHMARKS(small);
+LIFETIME_BENCHMARKS(large);
+LIFETIME_BENCHMARKS(function_pointer);
+
+FUNCTION_BENCHMARKS(bm_call, small);
+FUNCTION_BENCHMARKS(bm_call, large);
+FUNCTION_BENCHMARKS(bm_call, function_pointer);
+
+BENCHMARK_TEMPLATE(bm_construct, ours_member, make_member_pointer<ours_member>)
+    ->Name("bm_construct/member_pointer/function");
+BENCHMARK_TEMPLATE(bm_construct, std_member, make_member_pointer<std_member>)
+    ->Name("bm_construct/member_pointer/std::function");
+BENCHMARK_TEMPLATE(bm_copy, ours_member, make_member_pointer<ours_member>)
+    ->Name("bm_copy/member_pointer/function");
+BENCHMARK_TEMPLATE(bm_copy, std_member, make_member_pointer<std_member>)
+    ->Name("bm_copy/member_pointer/std::function");
+BENCHMARK_TEMPLATE(bm_call_member, ours_member, make_member_pointer<ours_member>)
+    ->Name("bm_call/member_pointer/function");
+BENCHMARK_TEMPLATE(bm_call_member, std_member, make_member_pointer<std_member>)
+    ->Name("bm_call/member_pointer/std::function");
+
+// the object is bound in, so the call looks like a plain int(int)
+ours make_bound_member() {
+  static holder h{1};
+  return bind_member<&holder::get>(&h);
+}
+
+std_function make_std_bound_member() {
+  static holder h{1};
+  return [p = &h](int x) { return p->get(x); };
+}
+
+BENCHMARK_TEMPLATE(bm_construct, ours, make_bound_member)
+    ->Name("bm_construct/bound_member/function");
+BENCHMARK_TEMPLATE(bm_construct, std_function, make_std_bound_member)
+    ->Name("bm_construct/bound_member/std::function");
+BENCHMARK_TEMPLATE(bm_call, ours, make_bound_member)
+    ->Name("bm_call/bound_member/function");
+BENCHMARK_TEMPLATE(bm_call, std_function, make_std_bound_member)
+    ->Name("bm_call/bound_member/std::function");
+
+// callers that know the stored type skip the indirect call
+template<typename Callable, ours (*make)()>
+void bm_invoke_as(benchmark::State &state) {
+  ours f = make();
+  int x = 0;
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(x = f.invoke_as<Callable>(x));
+  }
+}
+
+BENCHMARK_TEMPLATE(bm_invoke_as, small_callable, make_small<ours>)
+    ->Name("bm_invoke_as/small/function");
+BENCHMARK_TEMPLATE(bm_invoke_as, large_callable, make_large<ours>)
+    ->Name("bm_invoke_as/large/function");
+
+// calls with arguments of growing size, passed by value and by reference
+template<typename Function, typename Arg>
+void bm_call_argument(benchmark::State &state) {
+  Function f = [](auto &&arg) { return sizeof(arg); };
+  Arg arg{};
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f(arg));
+  }
+}
+
+using string_arg = std::string;
+using array_arg = std::array<char, 256>;
+
+#define ARGUMENT_BENCHMARKS(name, param)                                       \
+  BENCHMARK_TEMPLATE(bm_call_argument, function<size_t(param)>,                \
+                     std::remove_cv_t<std::remove_reference_t<param>>)         \
+      ->Name("bm_call_argument/" name "/function");                           \
+  BENCHMARK_TEMPLATE(bm_call_argument, std::function<size_t(param)>,           \
+                     std::remove_cv_t<std::remove_reference_t<param>>)         \
+      ->Name("bm_call_argument/" name "/std::function")
+
+ARGUMENT_BENCHMARKS("int", int);
+ARGUMENT_BENCHMARKS("string", string_arg);
+ARGUMENT_BENCHMARKS("string_cref", string_arg const &);
+ARGUMENT_BENCHMARKS("array256", array_arg);
+ARGUMENT_BENCHMARKS("array256_cref", array_arg const &);
+
+} // namespace
@@ -0,0 +1,294 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace functional_ {
+static constexpr size_t RECORD_ALIGN_OF = alignof(std::max_align_t);
+
+constexpr size_t round_up(size_t size, size_t align) noexcept {
+  return (size + align - 1) / align * align;
+}
+
+// the queue keeps callables back to back instead of in a fixed-size storage,
+// so its records carry their own layout next to move/destroy/apply
+template<typename... Args>
+struct record_operations {
+  void (*move)(void *, void *) noexcept;
+  void (*destroy)(void *) noexcept;
+  void (*apply)(void *, Args &&...);
+  size_t object_offset;
+  size_t record_size;
+};
+
+template<typename F, typename... Args>
+record_operations<Args...> const *get_record_operations() {
+  static constexpr size_t object_offset =
+      round_up(sizeof(void *), alignof(F));
+
+  static constexpr record_operations<Args...> operations = {
+      /* move */
+      [](void *dst, void *src) noexcept {
+        new(dst) F(std::move(*static_cast<F *>(src)));
+        static_cast<F *>(src)->~F();
+      },
+      /* destroy */
+      [](void *obj) noexcept {
+        static_cast<F *>(obj)->~F();
+      },
+      /* apply */
+      [](void *obj, Args &&...args) {
+        (*static_cast<F *>(obj))(std::forward<Args>(args)...);
+      },
+      object_offset,
+      round_up(object_offset + sizeof(F), RECORD_ALIGN_OF)
+  };
+  return &operations;
+}
+} // namespace functional_
+
+template<typename Signature>
+struct function_queue;
+
+// FIFO of type-erased callables stored inline in one ring buffer: pushing a
+// task costs no allocation unless the ring has to grow
+template<typename... Args>
+struct function_queue<void(Args...)> {
+  explicit function_queue(size_t capacity = 4096)
+      : buffer(new block[blocks_for(capacity)]),
+        buffer_size(blocks_for(capacity) * sizeof(block)) {}
+
+  function_queue(function_queue const &) = delete;
+  function_queue &operator=(function_queue const &) = delete;
+
+  function_queue(function_queue &&other) noexcept
+      : buffer(std::move(other.buffer)), buffer_size(other.buffer_size),
+        head(other.head), tail(other.tail), wrap_at(other.wrap_at),
+        count(other.count), wrapped(other.wrapped) {
+    other.buffer_size = 0;
+    other.reset_positions();
+  }
+
+  function_queue &operator=(function_queue &&rhs) noexcept {
+    if (&rhs == this)
+      return *this;
+    clear();
+    buffer = std::move(rhs.buffer);
+    buffer_size = rhs.buffer_size;
+    head = rhs.head;
+    tail = rhs.tail;
+    wrap_at = rhs.wrap_at;
+    count = rhs.count;
+    wrapped = rhs.wrapped;
+    rhs.buffer_size = 0;
+    rhs.reset_positions();
+    return *this;
+  }
+
+  ~function_queue() {
+    clear();
+  }
+
+  // returns false and leaves the queue untouched if f doesn't fit
+  template<typename F>
+  bool try_push(F f) {
+    auto ops = functional_::get_record_operations<F, Args...>();
+    size_t offset;
+    if (!find_space(ops->record_size, offset))
+      return false;
+    emplace(std::move(f), offset);
+    return true;
+  }
+
+  // grows the ring if f doesn't fit, also when called by a callable running
+  // from this queue
+  template<typename F>
+  void push(F f) {
+    auto ops = functional_::get_record_operations<F, Args...>();
+    size_t offset;
+    if (!find_space(ops->record_size, offset)) {
+      grow(ops->record_size);
+      find_space(ops->record_size, offset);
+    }
+    emplace(std::move(f), offset);
+  }
+
+  // invokes the oldest callable and removes it, even if it throws
+  bool pop_and_invoke(Args... args) {
+    assert(!running);
+    if (empty())
+      return false;
+    char *record = data() + head;
+    auto ops = record_ops(record);
+
+    struct pop_guard {
+      function_queue *queue;
+      functional_::record_operations<Args...> const *ops;
+      void *object;
+      ~pop_guard() {
+        queue->running = false;
+        if (queue->retired) {
+          ops->destroy(object);
+          queue->retired.reset();
+        } else {
+          queue->pop();
+        }
+      }
+    } guard{this, ops, record + ops->object_offset};
+    running = true;
+    ops->apply(record + ops->object_offset, std::forward<Args>(args)...);
+    return true;
+  }
+
+  // runs the callables that were queued when drain started, callables pushed
+  // by them are left for the next drain; returns how many were run. Each
+  // callable gets its own copy of args, so drain is only there when every
+  // argument type can be copied from a const reference
+  template<bool Copyable = (std::is_constructible_v<Args, Args const &> && ...),
+           std::enable_if_t<Copyable, int> = 0>
+  size_t drain(Args const &...args) {
+    size_t n = count;
+    for (size_t i = 0; i < n; ++i)
+      pop_and_invoke(args...);
+    return n;
+  }
+
+  void clear() noexcept {
+    while (!empty())
+      pop();
+  }
+
+  size_t size() const noexcept {
+    return count;
+  }
+
+  bool empty() const noexcept {
+    return count == 0;
+  }
+
+  size_t capacity() const noexcept {
+    return buffer_size;
+  }
+
+ private:
+  using block = std::aligned_storage_t<functional_::RECORD_ALIGN_OF,
+                                       functional_::RECORD_ALIGN_OF>;
+
+  static size_t blocks_for(size_t bytes) noexcept {
+    return functional_::round_up(bytes, sizeof(block)) / sizeof(block);
+  }
+
+  static functional_::record_operations<Args...> const *
+  record_ops(char *record) noexcept {
+    return *reinterpret_cast<functional_::record_operations<Args...> const **>(record);
+  }
+
+  template<typename F>
+  void emplace(F &&f, size_t offset) {
+    using ops_t = functional_::record_operations<Args...>;
+    static_assert(alignof(F) <= functional_::RECORD_ALIGN_OF,
+                  "over-aligned callables can't be stored inline");
+    static_assert(std::is_nothrow_move_constructible_v<F>,
+                  "callables are relocated when the queue grows");
+
+    ops_t const *ops = functional_::get_record_operations<F, Args...>();
+    char *record = data() + offset;
+    new(record + ops->object_offset) F(std::move(f));
+    *reinterpret_cast<ops_t const **>(record) = ops;
+    commit(offset, ops->record_size);
+  }
+
+  char *data() const noexcept {
+    return reinterpret_cast<char *>(buffer.get());
+  }
+
+  // records live in [head, tail), or in [head, wrap_at) and [0, tail) once
+  // the ring has wrapped
+  bool find_space(size_t size, size_t &offset) const noexcept {
+    if (!wrapped) {
+      if (size <= buffer_size - tail) {
+        offset = tail;
+        return true;
+      }
+      if (size <= head) {
+        offset = 0;
+        return true;
+      }
+      return false;
+    }
+    if (size <= head - tail) {
+      offset = tail;
+      return true;
+    }
+    return false;
+  }
+
+  void commit(size_t offset, size_t size) noexcept {
+    if (offset != tail) {
+      wrap_at = tail;
+      wrapped = true;
+    }
+    tail = offset + size;
+    ++count;
+  }
+
+  void pop() noexcept {
+    char *record = data() + head;
+    auto ops = record_ops(record);
+    ops->destroy(record + ops->object_offset);
+    advance(ops->record_size);
+  }
+
+  void advance(size_t record_size) noexcept {
+    head += record_size;
+    --count;
+    if (wrapped && head == wrap_at) {
+      head = 0;
+      wrapped = false;
+    }
+    if (count == 0)
+      reset_positions();
+  }
+
+  void reset_positions() noexcept {
+    head = tail = wrap_at = count = 0;
+    wrapped = false;
+  }
+
+  // the running callable isn't moved: its record leaves the queue, and the
+  // old buffer is kept until the call returns
+  void grow(size_t required) {
+    size_t new_size = std::max(2 * buffer_size, buffer_size + required);
+    function_queue grown(new_size);
+    bool keep_running = running && !retired;
+    if (keep_running)
+      advance(record_ops(data() + head)->record_size);
+    while (!empty()) {
+      char *record = data() + head;
+      auto ops = record_ops(record);
+      char *dst = grown.data() + grown.tail;
+      ops->move(dst + ops->object_offset, record + ops->object_offset);
+      *reinterpret_cast<functional_::record_operations<Args...> const **>(dst) = ops;
+      grown.commit(grown.tail, ops->record_size);
+      advance(ops->record_size);
+    }
+    if (keep_running)
+      retired = std::move(buffer);
+    *this = std::move(grown);
+  }
+
+  std::unique_ptr<block[]> buffer;
+  size_t buffer_size;
+  size_t head = 0;
+  size_t tail = 0;
+  size_t wrap_at = 0;
+  size_t count = 0;
+  bool wrapped = false;
+  bool running = false;
+  // holds the running callable once the ring has grown under it
+  std::unique_ptr<block[]> retired;
+};
@@ -0,0 +1,251 @@
+#include <gtest/gtest.h>
+#include "function_queue.h"
+
+#include <array>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+struct counted_task
+{
+    counted_task(std::vector<int>& log, int id) noexcept
+        : log(&log)
+        , id(id)
+    {
+        ++n_instances;
+    }
+
+    counted_task(counted_task const& other) noexcept
+        : log(other.log)
+        , id(other.id)
+    {
+        ++n_instances;
+    }
+
+    ~counted_task()
+    {
+        --n_instances;
+    }
+
+    void operator()() const
+    {
+        log->push_back(id);
+    }
+
+    static size_t n_instances;
+
+private:
+    std::vector<int>* log;
+    int id;
+};
+
+size_t counted_task::n_instances = 0;
+
+struct large_task : counted_task
+{
+    using counted_task::counted_task;
+
+    std::array<char, 200> payload{};
+};
+}
+
+TEST(function_queue_test, empty)
+{
+    function_queue<void ()> q;
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(0, q.size());
+    EXPECT_FALSE(q.pop_and_invoke());
+}
+
+TEST(function_queue_test, fifo_order)
+{
+    std::vector<int> log;
+    {
+        function_queue<void ()> q;
+        q.push(counted_task(log, 1));
+        q.push(large_task(log, 2));
+        q.push([&log] { log.push_back(3); });
+        EXPECT_EQ(3, q.size());
+        while (q.pop_and_invoke())
+        {}
+        EXPECT_TRUE(q.empty());
+    }
+    EXPECT_EQ((std::vector<int>{1, 2, 3}), log);
+    EXPECT_EQ(0, counted_task::n_instances);
+}
+
+TEST(function_queue_test, arguments)
+{
+    function_queue<void (int&, int)> q;
+    q.push([](int& acc, int x) { acc += x; });
+    q.push([](int& acc, int x) { acc *= x; });
+    int acc = 1;
+    EXPECT_EQ(2, q.drain(acc, 3));
+    EXPECT_EQ(12, acc);
+}
+
+TEST(function_queue_test, wrap_around)
+{
+    std::vector<int> log;
+    std::vector<int> expected;
+    {
+        function_queue<void ()> q(1024);
+        size_t capacity = q.capacity();
+        int next = 0;
+        for (int round = 0; round < 100; ++round)
+        {
+            while (q.try_push(large_task(log, next)))
+                expected.push_back(next++);
+            EXPECT_FALSE(q.empty());
+            q.pop_and_invoke();
+            q.pop_and_invoke();
+            EXPECT_TRUE(q.try_push(counted_task(log, next)));
+            expected.push_back(next++);
+        }
+        q.drain();
+        EXPECT_EQ(capacity, q.capacity());
+    }
+    EXPECT_EQ(expected, log);
+    EXPECT_EQ(0, counted_task::n_instances);
+}
+
+TEST(function_queue_test, try_push_full)
+{
+    std::vector<int> log;
+    function_queue<void ()> q(256);
+    size_t pushed = 0;
+    while (q.try_push(large_task(log, 0)))
+        ++pushed;
+    EXPECT_EQ(pushed, q.size());
+    EXPECT_EQ(pushed, counted_task::n_instances);
+}
+
+TEST(function_queue_test, push_grows)
+{
+    std::vector<int> log;
+    std::vector<int> expected;
+    {
+        function_queue<void ()> q(64);
+        for (int i = 0; i < 100; ++i)
+        {
+            if (i % 3 == 0)
+                q.push(large_task(log, i));
+            else
+                q.push(counted_task(log, i));
+            expected.push_back(i);
+            if (i % 10 == 0)
+                q.pop_and_invoke();
+        }
+        EXPECT_GT(q.capacity(), 64);
+        q.drain();
+    }
+    EXPECT_EQ(expected, log);
+    EXPECT_EQ(0, counted_task::n_instances);
+}
+
+TEST(function_queue_test, push_grows_under_running_task)
+{
+    std::vector<int> log;
+    {
+        function_queue<void ()> q(64);
+        q.push(counted_task(log, 0));
+        q.push([&q, &log, task = counted_task(log, 1)] {
+            for (int i = 2; i < 10; ++i)
+                q.push(large_task(log, i));
+            // still callable: growing the ring didn't move it
+            task();
+        });
+        q.push(counted_task(log, 10));
+        q.drain();
+        EXPECT_GT(q.capacity(), 64);
+        EXPECT_EQ(8, q.size());
+        q.drain();
+    }
+    EXPECT_EQ((std::vector<int>{0, 1, 10, 2, 3, 4, 5, 6, 7, 8, 9}), log);
+    EXPECT_EQ(0, counted_task::n_instances);
+}
+
+TEST(function_queue_test, drain_skips_pushed_during_drain)
+{
+    function_queue<void ()> q;
+    int calls = 0;
+    q.push([&] {
+        ++calls;
+        q.try_push([&] { ++calls; });
+    });
+    EXPECT_EQ(1, q.drain());
+    EXPECT_EQ(1, calls);
+    EXPECT_EQ(1, q.size());
+    EXPECT_EQ(1, q.drain());
+    EXPECT_EQ(2, calls);
+}
+
+namespace
+{
+template<typename Queue, typename Arg, typename = void>
+struct drains_with : std::false_type
+{};
+
+template<typename Queue, typename Arg>
+struct drains_with<Queue, Arg, std::void_t<decltype(std::declval<Queue&>().drain(std::declval<Arg&>()))>>
+    : std::true_type
+{};
+}
+
+TEST(function_queue_test, drain_needs_copyable_arguments)
+{
+    static_assert(drains_with<function_queue<void (int)>, int>::value);
+    static_assert(drains_with<function_queue<void (int&)>, int>::value);
+    static_assert(!drains_with<function_queue<void (int&&)>, int>::value);
+    static_assert(!drains_with<function_queue<void (std::unique_ptr<int>)>, std::unique_ptr<int>>::value);
+
+    function_queue<void (std::unique_ptr<int>)> q;
+    int sum = 0;
+    q.push([&](std::unique_ptr<int> p) { sum += *p; });
+    q.push([&](std::unique_ptr<int> p) { sum += 2 * *p; });
+    while (q.pop_and_invoke(std::make_unique<int>(1)))
+    {}
+    EXPECT_EQ(3, sum);
+}
+
+TEST(function_queue_test, throwing_task_is_popped)
+{
+    struct test_exception : std::exception
+    {};
+
+    std::vector<int> log;
+    function_queue<void ()> q;
+    q.push([] { throw test_exception(); });
+    q.push(counted_task(log, 1));
+    EXPECT_THROW(q.pop_and_invoke(), test_exception);
+    EXPECT_EQ(1, q.size());
+    q.pop_and_invoke();
+    EXPECT_EQ((std::vector<int>{1}), log);
+}
+
+TEST(function_queue_test, destroy_pending)
+{
+    std::vector<int> log;
+    {
+        function_queue<void ()> q;
+        q.push(counted_task(log, 1));
+        q.push(large_task(log, 2));
+    }
+    EXPECT_TRUE(log.empty());
+    EXPECT_EQ(0, counted_task::n_instances);
+}
+
+TEST(function_queue_test, move)
+{
+    std::vector<int> log;
+    function_queue<void ()> q;
+    q.push(counted_task(log, 1));
+    function_queue<void ()> r = std::move(q);
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(1, r.size());
+    q = std::move(r);
+    q.drain();
+    EXPECT_EQ((std::vector<int>{1}), log);
+}
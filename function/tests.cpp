@@ -1,6 +1,11 @@
 #include <gtest/gtest.h>
 #include "function.h"
 
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
 TEST(function_test, default_ctor)
 {
     function<void ()> x;
@@ -398,6 +403,454 @@ TEST(function_test, target)
     EXPECT_NE(nullptr, std::as_const(f).target<bar>());
 }
 
+struct counting_arg
+{
+    counting_arg() = default;
+
+    counting_arg(counting_arg const&)
+    {
+        ++copies;
+    }
+
+    counting_arg(counting_arg&&) noexcept
+    {
+        ++moves;
+    }
+
+    static void reset()
+    {
+        copies = 0;
+        moves = 0;
+    }
+
+    static size_t copies;
+    static size_t moves;
+};
+
+size_t counting_arg::copies = 0;
+size_t counting_arg::moves = 0;
+
+TEST(function_test, argument_by_value_moves)
+{
+    function<void (counting_arg)> f = [](counting_arg) {};
+    counting_arg::reset();
+    f(counting_arg());
+    EXPECT_EQ(0, counting_arg::copies);
+    EXPECT_EQ(1, counting_arg::moves);
+}
+
+TEST(function_test, argument_by_value_moves_large)
+{
+    int big_array[1000] = {};
+    function<void (counting_arg)> f = [big_array](counting_arg) { (void) big_array; };
+    counting_arg::reset();
+    f(counting_arg());
+    EXPECT_EQ(0, counting_arg::copies);
+    EXPECT_EQ(1, counting_arg::moves);
+}
+
+TEST(function_test, argument_by_value_lvalue)
+{
+    function<void (counting_arg)> f = [](counting_arg) {};
+    counting_arg a;
+    counting_arg::reset();
+    f(a);
+    EXPECT_EQ(1, counting_arg::copies);
+    EXPECT_EQ(1, counting_arg::moves);
+}
+
+TEST(function_test, argument_by_cref_no_copies)
+{
+    function<void (counting_arg const&)> f = [](counting_arg const&) {};
+    counting_arg a;
+    counting_arg::reset();
+    f(a);
+    EXPECT_EQ(0, counting_arg::copies);
+    EXPECT_EQ(0, counting_arg::moves);
+}
+
+// the argument reaches the callable without a move; the one move builds
+// the result from the returned reference
+TEST(function_test, argument_by_rvalue_ref_moved_only_into_result)
+{
+    function<counting_arg (counting_arg&&)> f = [](counting_arg&& a) -> counting_arg&& { return std::move(a); };
+    counting_arg::reset();
+    counting_arg b = f(counting_arg());
+    (void) b;
+    EXPECT_EQ(0, counting_arg::copies);
+    EXPECT_EQ(1, counting_arg::moves);
+}
+
+TEST(function_test, heavy_arguments_large)
+{
+    int big_array[1000] = {};
+    function<size_t (std::string, std::vector<int> const&)> f =
+        [big_array](std::string s, std::vector<int> const& v) { return s.size() + v.size() + big_array[0]; };
+    std::vector<int> v(100);
+    EXPECT_EQ(105, f(std::string("hello"), v));
+}
+
+struct counting_resource : std::pmr::memory_resource
+{
+    size_t allocations = 0;
+    size_t deallocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        ++deallocations;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+TEST(function_test, resource_large_func)
+{
+    counting_resource resource;
+    {
+        function<int ()> f(std::allocator_arg, &resource, large_func(42));
+        EXPECT_EQ(1, resource.allocations);
+        EXPECT_EQ(42, f());
+        EXPECT_EQ(42, f.target<large_func>()->get_value());
+    }
+    EXPECT_EQ(1, resource.deallocations);
+    large_func::assert_no_instances();
+}
+
+TEST(function_test, resource_small_func)
+{
+    counting_resource resource;
+    {
+        function<int ()> f(std::allocator_arg, &resource, small_func(42));
+        function<int ()> g = f;
+        EXPECT_EQ(42, g());
+    }
+    EXPECT_EQ(0, resource.allocations);
+    EXPECT_EQ(0, resource.deallocations);
+}
+
+TEST(function_test, resource_copy)
+{
+    counting_resource resource;
+    {
+        function<int ()> f(std::allocator_arg, &resource, large_func(42));
+        function<int ()> g = f;
+        function<int ()> h;
+        h = g;
+        EXPECT_EQ(3, resource.allocations);
+        EXPECT_EQ(42, g());
+        EXPECT_EQ(42, h());
+    }
+    EXPECT_EQ(3, resource.deallocations);
+}
+
+TEST(function_test, resource_move)
+{
+    counting_resource resource;
+    {
+        function<int ()> f(std::allocator_arg, &resource, large_func(42));
+        function<int ()> g = std::move(f);
+        function<int ()> h;
+        h = std::move(g);
+        EXPECT_EQ(1, resource.allocations);
+        EXPECT_EQ(42, h());
+    }
+    EXPECT_EQ(1, resource.deallocations);
+}
+
+TEST(function_test, resource_throwing_copy)
+{
+    counting_resource resource;
+    int big_array[1000] = {};
+    {
+        function<int ()> f(std::allocator_arg, &resource, [big_array, t = throwing_copy()] { return big_array[0]; });
+        EXPECT_THROW(function<int ()> g = f, throwing_copy::exception);
+        EXPECT_EQ(2, resource.allocations);
+        EXPECT_EQ(1, resource.deallocations);
+    }
+    EXPECT_EQ(2, resource.deallocations);
+}
+
+TEST(function_test, resource_monotonic_buffer)
+{
+    alignas(std::max_align_t) char buffer[16384];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof buffer, std::pmr::null_memory_resource());
+    function<int ()> f(std::allocator_arg, &arena, large_func(42));
+    function<int ()> g = f;
+    EXPECT_EQ(42, f());
+    EXPECT_EQ(42, g());
+}
+
+struct overloaded_handler
+{
+    int operator()(int x) const
+    {
+        return x + 1;
+    }
+
+    std::string operator()(std::string_view s) const
+    {
+        return std::string(s) + "!";
+    }
+};
+
+TEST(function_test, multi_signature)
+{
+    function<int (int), std::string (std::string_view)> f = overloaded_handler();
+    EXPECT_EQ(42, f(41));
+    EXPECT_EQ("hi!", f(std::string_view("hi")));
+    EXPECT_NE(nullptr, f.target<overloaded_handler>());
+}
+
+TEST(function_test, multi_signature_empty)
+{
+    function<int (int), std::string (std::string_view)> f;
+    EXPECT_FALSE(static_cast<bool>(f));
+    EXPECT_THROW(f(1), bad_function_call);
+    EXPECT_THROW(f(std::string_view("hi")), bad_function_call);
+}
+
+TEST(function_test, multi_signature_large_single_allocation)
+{
+    struct large_handler : overloaded_handler
+    {
+        int payload[1000] = {};
+    };
+
+    counting_resource resource;
+    {
+        function<int (int), std::string (std::string_view), void ()> f(std::allocator_arg, &resource, [h = large_handler()](auto&&... args) {
+            if constexpr (sizeof...(args) != 0)
+                return h(std::forward<decltype(args)>(args)...);
+        });
+        EXPECT_EQ(1, resource.allocations);
+        EXPECT_EQ(42, f(41));
+        EXPECT_EQ("hi!", f(std::string_view("hi")));
+        EXPECT_NO_THROW(f());
+
+        auto g = f;
+        EXPECT_EQ(2, resource.allocations);
+        EXPECT_EQ(42, g(41));
+
+        auto h = std::move(f);
+        EXPECT_FALSE(static_cast<bool>(f));
+        EXPECT_EQ("hi!", h(std::string_view("hi")));
+    }
+    EXPECT_EQ(2, resource.deallocations);
+}
+
+TEST(function_test, void_result_discarded)
+{
+    int calls = 0;
+    function<void ()> f = [&calls] { return ++calls; };
+    f();
+    EXPECT_EQ(1, calls);
+}
+
+TEST(function_test, invoke_as_stored_type)
+{
+    function<int ()> f = small_func(42);
+    EXPECT_EQ(42, f.invoke_as<small_func>());
+    f = large_func(43);
+    EXPECT_EQ(43, f.invoke_as<large_func>());
+}
+
+TEST(function_test, invoke_as_other_type)
+{
+    function<int ()> f = large_func(42);
+    EXPECT_EQ(42, f.invoke_as<small_func>());
+}
+
+TEST(function_test, invoke_as_empty)
+{
+    function<int ()> f;
+    EXPECT_THROW(f.invoke_as<small_func>(), bad_function_call);
+}
+
+TEST(function_test, invoke_as_multi_signature)
+{
+    function<int (int), std::string (std::string_view)> f = overloaded_handler();
+    EXPECT_EQ(42, f.invoke_as<overloaded_handler>(41));
+    EXPECT_EQ("hi!", f.invoke_as<overloaded_handler>(std::string_view("hi")));
+}
+
+TEST(function_test, invoke_as_arguments)
+{
+    function<void (counting_arg)> f = [](counting_arg) {};
+    counting_arg::reset();
+    f.invoke_as<decltype(f)>(counting_arg());
+    EXPECT_EQ(0, counting_arg::copies);
+}
+
+struct accumulator
+{
+    int operator()(int x) const
+    {
+        return total + x;
+    }
+
+    int total = 0;
+};
+
+TEST(function_test, visit_as)
+{
+    function<int (int)> f = accumulator();
+    EXPECT_TRUE(f.visit_as<accumulator>([](accumulator& a) { a.total = 10; }));
+    EXPECT_EQ(15, f(5));
+
+    bool called = false;
+    EXPECT_FALSE(f.visit_as<small_func>([&](small_func&) { called = true; }));
+    EXPECT_FALSE(called);
+
+    int seen = 0;
+    EXPECT_TRUE(std::as_const(f).visit_as<accumulator>([&](accumulator const& a) { seen = a.total; }));
+    EXPECT_EQ(10, seen);
+}
+
+TEST(function_test, visit_as_empty)
+{
+    function<int (int)> f;
+    EXPECT_FALSE(f.visit_as<accumulator>([](accumulator&) {}));
+}
+
+int add_one(int x)
+{
+    return x + 1;
+}
+
+struct counter
+{
+    int value = 0;
+
+    int add(int x)
+    {
+        return value += x;
+    }
+
+    int get() const
+    {
+        return value;
+    }
+};
+
+TEST(function_test, function_pointer_inline)
+{
+    counting_resource resource;
+    {
+        function<int (int)> f(std::allocator_arg, &resource, &add_one);
+        EXPECT_EQ(42, f(41));
+        ASSERT_NE(nullptr, f.target<int (*)(int)>());
+        EXPECT_EQ(&add_one, *f.target<int (*)(int)>());
+        function<int (int)> g = f;
+        EXPECT_EQ(42, g(41));
+    }
+    EXPECT_EQ(0, resource.allocations);
+}
+
+TEST(function_test, member_function_pointer)
+{
+    counting_resource resource;
+    {
+        function<int (counter&, int)> add(std::allocator_arg, &resource, &counter::add);
+        function<int (counter const*)> get(std::allocator_arg, &resource, &counter::get);
+        counter c;
+        EXPECT_EQ(5, add(c, 5));
+        EXPECT_EQ(7, add(c, 2));
+        EXPECT_EQ(7, get(&c));
+    }
+    EXPECT_EQ(0, resource.allocations);
+}
+
+TEST(function_test, data_member_pointer)
+{
+    function<int (counter const&)> f = &counter::value;
+    counter c;
+    c.value = 42;
+    EXPECT_EQ(42, f(c));
+}
+
+TEST(function_test, bind_member)
+{
+    counting_resource resource;
+    counter c;
+    {
+        function<int (int)> f(std::allocator_arg, &resource, bind_member<&counter::add>(&c));
+        function<int ()> g(std::allocator_arg, &resource, bind_member(&c, &counter::get));
+        EXPECT_EQ(3, f(3));
+        EXPECT_EQ(5, f(2));
+        EXPECT_EQ(5, g());
+
+        auto h = std::move(g);
+        EXPECT_EQ(5, h());
+    }
+    EXPECT_EQ(0, resource.allocations);
+    EXPECT_EQ(5, c.value);
+}
+
+TEST(function_test, three_word_capture_inline)
+{
+    counting_resource resource;
+    int a = 1, b = 2, c = 3;
+    {
+        function<int ()> f(std::allocator_arg, &resource, [pa = &a, pb = &b, pc = &c] { return *pa + *pb + *pc; });
+        function<int ()> g = f;
+        EXPECT_EQ(6, f());
+        EXPECT_EQ(6, g());
+    }
+    EXPECT_EQ(0, resource.allocations);
+}
+
+// small enough for the buffer, but has to be moved with its constructor
+struct self_pointing_func
+{
+    self_pointing_func(int value) noexcept
+        : that(this)
+        , value(value)
+    {}
+
+    self_pointing_func(self_pointing_func const& other) noexcept
+        : that(this)
+        , value(other.value)
+    {}
+
+    int operator()() const
+    {
+        EXPECT_EQ(this, that);
+        return value;
+    }
+
+private:
+    self_pointing_func const* that;
+    int value;
+};
+
+TEST(function_test, inline_func_swap)
+{
+    function<int ()> f = self_pointing_func(1);
+    function<int ()> g = self_pointing_func(2);
+    f.swap(g);
+    EXPECT_EQ(2, f());
+    EXPECT_EQ(1, g());
+
+    g = large_func(3);
+    f.swap(g);
+    EXPECT_EQ(3, f());
+    EXPECT_EQ(2, g());
+
+    f = std::move(g);
+    EXPECT_EQ(2, f());
+}
+
 int main(int argc, char *argv[])
 {
     testing::InitGoogleTest(&argc, argv);
@@ -2,6 +2,12 @@
 #include "tests-extra/test-object.h"
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
 template <typename T>
 struct custom_deleter {
   explicit custom_deleter(bool* deleted) : deleted(deleted) {}
@@ -136,6 +142,27 @@ TEST(shared_ptr_testing, weak_ptr_assignment_operator_self_nullptr) {
   EXPECT_FALSE(static_cast<bool>(q.lock()));
 }
 
+TEST(shared_ptr_testing, weak_ptr_expired_use_count) {
+  test_object::no_new_instances_guard g;
+  weak_ptr<test_object> empty;
+  EXPECT_TRUE(empty.expired());
+  EXPECT_EQ(0, empty.use_count());
+
+  shared_ptr<test_object> p(new test_object(42));
+  weak_ptr<test_object> q = p;
+  EXPECT_FALSE(q.expired());
+  EXPECT_EQ(1, q.use_count());
+
+  shared_ptr<test_object> r = q.lock();
+  EXPECT_EQ(2, q.use_count());
+
+  p.reset();
+  r.reset();
+  EXPECT_TRUE(q.expired());
+  EXPECT_EQ(0, q.use_count());
+  EXPECT_FALSE(static_cast<bool>(q.lock()));
+}
+
 TEST(shared_ptr_testing, weak_ptr_move_assignment_operator) {
   test_object::no_new_instances_guard g;
   shared_ptr<test_object> p1(new test_object(42));
@@ -262,3 +289,353 @@ TEST(shared_ptr_testing, conversions_inheritance) {
   shared_ptr<base> b = d;
   EXPECT_EQ(d.get(), b.get());
 }
+
+static_assert(!std::is_convertible_v<local_shared_ptr<int>, shared_ptr<int>>);
+static_assert(!std::is_convertible_v<shared_ptr<int>, local_shared_ptr<int>>);
+
+TEST(shared_ptr_testing, local_shared_ptr) {
+  test_object::no_new_instances_guard g;
+  local_shared_ptr<test_object> p(new test_object(42));
+  local_shared_ptr<test_object> q = p;
+  EXPECT_EQ(2, p.use_count());
+  EXPECT_EQ(42, *q);
+  p.reset();
+  EXPECT_EQ(1, q.use_count());
+}
+
+TEST(shared_ptr_testing, make_local_shared) {
+  test_object::no_new_instances_guard g;
+  local_weak_ptr<test_object> w;
+  {
+    local_shared_ptr<test_object> p = make_local_shared<test_object>(42);
+    w = p;
+    EXPECT_EQ(42, *w.lock());
+  }
+  EXPECT_FALSE(static_cast<bool>(w.lock()));
+}
+
+TEST(shared_ptr_testing, local_custom_deleter_inheritance) {
+  bool deleted = false;
+  {
+    local_shared_ptr<derived> d(new derived(&deleted));
+    local_shared_ptr<base> b = d;
+    d.reset();
+    EXPECT_FALSE(deleted);
+  }
+  EXPECT_TRUE(deleted);
+}
+
+static_assert(!std::is_polymorphic_v<shared_ptr_details::obj_block<
+                  int, std::allocator<int>, atomic_refcount>>);
+static_assert(!std::is_polymorphic_v<shared_ptr_details::ptr_block<
+                  int, std::default_delete<int>, std::allocator<int>,
+                  atomic_refcount>>);
+
+TEST(shared_ptr_testing, dispose_before_destroy) {
+  test_object::no_new_instances_guard g;
+  weak_ptr<test_object> w;
+  {
+    shared_ptr<test_object> p = make_shared<test_object>(42);
+    w = p;
+  }
+  g.expect_no_instances();
+  EXPECT_EQ(0, w.lock().use_count());
+}
+
+namespace {
+struct allocation_stats {
+  size_t allocations = 0;
+  size_t deallocations = 0;
+  bool fail = false;
+};
+
+template <typename T>
+struct counting_allocator {
+  using value_type = T;
+
+  explicit counting_allocator(allocation_stats* stats) noexcept
+      : stats(stats) {}
+
+  template <typename U>
+  counting_allocator(counting_allocator<U> const& other) noexcept
+      : stats(other.stats) {}
+
+  T* allocate(size_t n) {
+    if (stats->fail) {
+      throw std::bad_alloc();
+    }
+    stats->allocations += 1;
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    stats->deallocations += 1;
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(counting_allocator<U> const& other) const noexcept {
+    return stats == other.stats;
+  }
+
+  template <typename U>
+  bool operator!=(counting_allocator<U> const& other) const noexcept {
+    return stats != other.stats;
+  }
+
+  allocation_stats* stats;
+};
+} // namespace
+
+TEST(shared_ptr_testing, allocate_shared) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  weak_ptr<test_object> w;
+  {
+    shared_ptr<test_object> p = allocate_shared<test_object>(
+        counting_allocator<test_object>(&stats), 42);
+    EXPECT_EQ(42, *p);
+    EXPECT_EQ(1, stats.allocations);
+    w = p;
+  }
+  g.expect_no_instances();
+  EXPECT_EQ(0, stats.deallocations);
+  w = weak_ptr<test_object>();
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_ptr_testing, ptr_ctor_allocator) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  bool deleted = false;
+  {
+    shared_ptr<test_object> p(new test_object(42),
+                              custom_deleter<test_object>(&deleted),
+                              counting_allocator<int>(&stats));
+    EXPECT_EQ(42, *p);
+    EXPECT_EQ(1, stats.allocations);
+  }
+  EXPECT_TRUE(deleted);
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_ptr_testing, ptr_ctor_allocator_failure) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  stats.fail = true;
+  bool deleted = false;
+  EXPECT_THROW((shared_ptr<test_object>(new test_object(42),
+                                        custom_deleter<test_object>(&deleted),
+                                        counting_allocator<int>(&stats))),
+               std::bad_alloc);
+  EXPECT_TRUE(deleted);
+}
+
+TEST(shared_ptr_testing, pool_allocator_reuses_blocks) {
+  test_object* first;
+  {
+    shared_ptr<test_object> p =
+        allocate_shared<test_object>(pool_allocator<test_object>(), 1);
+    first = p.get();
+  }
+  shared_ptr<test_object> q =
+      allocate_shared<test_object>(pool_allocator<test_object>(), 2);
+  EXPECT_EQ(first, q.get());
+  EXPECT_EQ(2, *q);
+
+  local_shared_ptr<int> r(new int(3), std::default_delete<int>(),
+                          pool_allocator<int>());
+  EXPECT_EQ(3, *r);
+}
+
+namespace {
+struct self_owning : enable_shared_from_this<self_owning> {
+  explicit self_owning(int value) : value(value) {}
+
+  int value;
+};
+
+struct self_owning_derived : self_owning {
+  using self_owning::self_owning;
+};
+
+struct local_self_owning
+    : enable_shared_from_this<local_self_owning, local_refcount> {};
+} // namespace
+
+TEST(shared_ptr_testing, shared_from_this_make_shared) {
+  shared_ptr<self_owning> p = make_shared<self_owning>(42);
+  shared_ptr<self_owning> q = p->shared_from_this();
+  EXPECT_EQ(p, q);
+  EXPECT_EQ(2, p.use_count());
+  EXPECT_EQ(42, q->value);
+}
+
+TEST(shared_ptr_testing, shared_from_this_ptr_ctor) {
+  allocation_stats stats;
+  shared_ptr<self_owning> p(new self_owning(42),
+                            std::default_delete<self_owning>(),
+                            counting_allocator<int>(&stats));
+  shared_ptr<self_owning const> q = std::as_const(*p).shared_from_this();
+  EXPECT_EQ(p.get(), q.get());
+  EXPECT_EQ(2, p.use_count());
+  EXPECT_EQ(1, stats.allocations);
+}
+
+TEST(shared_ptr_testing, shared_from_this_derived) {
+  shared_ptr<self_owning> p(new self_owning_derived(1));
+  EXPECT_EQ(p, p->shared_from_this());
+  shared_ptr<self_owning_derived> d = make_shared<self_owning_derived>(2);
+  EXPECT_EQ(d.get(), d->shared_from_this().get());
+}
+
+TEST(shared_ptr_testing, shared_from_this_not_owned) {
+  self_owning object(42);
+  EXPECT_THROW(object.shared_from_this(), std::bad_weak_ptr);
+  EXPECT_FALSE(static_cast<bool>(object.weak_from_this().lock()));
+}
+
+TEST(shared_ptr_testing, shared_from_this_expired) {
+  weak_ptr<self_owning> w;
+  {
+    shared_ptr<self_owning> p = make_shared<self_owning>(42);
+    w = p->weak_from_this();
+    EXPECT_EQ(p, w.lock());
+  }
+  EXPECT_FALSE(static_cast<bool>(w.lock()));
+}
+
+TEST(shared_ptr_testing, shared_from_this_copy_not_shared) {
+  shared_ptr<self_owning> p = make_shared<self_owning>(42);
+  self_owning copy = *p;
+  EXPECT_THROW(copy.shared_from_this(), std::bad_weak_ptr);
+  shared_ptr<self_owning> q = make_shared<self_owning>(*p);
+  EXPECT_NE(p, q->shared_from_this());
+}
+
+TEST(shared_ptr_testing, shared_from_this_local) {
+  local_shared_ptr<local_self_owning> p = make_local_shared<local_self_owning>();
+  EXPECT_EQ(p, p->shared_from_this());
+}
+
+namespace {
+struct tracked_element {
+  tracked_element() : id(constructed++) {
+    if (id + 1 == throw_at) {
+      constructed--;
+      throw std::runtime_error("tracked_element");
+    }
+  }
+
+  ~tracked_element() {
+    destroyed_ids.push_back(id);
+  }
+
+  size_t id;
+
+  static inline size_t constructed = 0;
+  static inline size_t throw_at = 0;
+  static inline std::vector<size_t> destroyed_ids;
+
+  static void reset() {
+    constructed = 0;
+    throw_at = 0;
+    destroyed_ids.clear();
+  }
+};
+} // namespace
+
+static_assert(std::is_same_v<shared_ptr<int[]>::element_type, int>);
+static_assert(std::is_same_v<shared_ptr<int[4]>::element_type, int>);
+static_assert(!std::is_constructible_v<shared_ptr<base[]>, derived*>);
+static_assert(std::is_constructible_v<shared_ptr<int const[]>, int*>);
+
+TEST(shared_ptr_testing, make_shared_array) {
+  shared_ptr<int[]> p = make_shared<int[]>(5);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(0, p[i]);
+    p[i] = i;
+  }
+  shared_ptr<int[]> q = p;
+  EXPECT_EQ(2, q.use_count());
+  EXPECT_EQ(4, q[4]);
+  EXPECT_EQ(p.get(), &q[0]);
+}
+
+TEST(shared_ptr_testing, make_shared_bounded_array) {
+  shared_ptr<double[3]> p = make_shared<double[3]>();
+  EXPECT_EQ(0.0, p[2]);
+  weak_ptr<double[3]> w = p;
+  p[1] = 1.5;
+  EXPECT_EQ(1.5, w.lock()[1]);
+}
+
+TEST(shared_ptr_testing, make_shared_array_aligned) {
+  struct alignas(64) line {
+    char data[64];
+  };
+  shared_ptr<line[]> p = make_shared<line[]>(3);
+  EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(p.get()) % 64);
+  EXPECT_EQ(0, p[2].data[63]);
+}
+
+TEST(shared_ptr_testing, make_shared_array_destruction_order) {
+  tracked_element::reset();
+  {
+    shared_ptr<tracked_element[]> p = make_shared<tracked_element[]>(3);
+    EXPECT_EQ(2, p[2].id);
+  }
+  EXPECT_EQ((std::vector<size_t>{2, 1, 0}), tracked_element::destroyed_ids);
+}
+
+TEST(shared_ptr_testing, make_shared_array_throwing_element) {
+  tracked_element::reset();
+  tracked_element::throw_at = 3;
+  EXPECT_THROW(make_shared<tracked_element[]>(5), std::runtime_error);
+  EXPECT_EQ((std::vector<size_t>{1, 0}), tracked_element::destroyed_ids);
+  tracked_element::reset();
+}
+
+TEST(shared_ptr_testing, make_shared_for_overwrite) {
+  shared_ptr<int[]> buffer = make_shared_for_overwrite<int[]>(1024);
+  buffer[1023] = 7;
+  EXPECT_EQ(7, buffer[1023]);
+
+  shared_ptr<int[16]> fixed = make_shared_for_overwrite<int[16]>();
+  fixed[0] = 1;
+  EXPECT_EQ(1, fixed[0]);
+
+  shared_ptr<int> single = make_shared_for_overwrite<int>();
+  *single = 3;
+  EXPECT_EQ(3, *single);
+}
+
+TEST(shared_ptr_testing, ptr_ctor_array) {
+  tracked_element::reset();
+  {
+    shared_ptr<tracked_element[]> p(new tracked_element[3]);
+    shared_ptr<tracked_element[]> q;
+    q.reset(new tracked_element[2]);
+  }
+  EXPECT_EQ(5, tracked_element::destroyed_ids.size());
+  tracked_element::reset();
+}
+
+TEST(shared_ptr_testing, ptr_ctor_bounded_array) {
+  tracked_element::reset();
+  {
+    shared_ptr<tracked_element[4]> p(new tracked_element[4]);
+    EXPECT_EQ(3, p[3].id);
+    shared_ptr<int[4]> q(new int[4]);
+    q.reset(new int[4]);
+  }
+  EXPECT_EQ(4, tracked_element::destroyed_ids.size());
+  tracked_element::reset();
+}
+
+TEST(shared_ptr_testing, make_shared_array_size_overflow) {
+  size_t huge = std::numeric_limits<size_t>::max() / sizeof(uint64_t) + 2;
+  EXPECT_THROW(make_shared<uint64_t[]>(huge), std::bad_array_new_length);
+  EXPECT_THROW(make_shared<char[]>(std::numeric_limits<size_t>::max()),
+               std::bad_array_new_length);
+}
@@ -0,0 +1,122 @@
+#include "atomic-shared-ptr.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+TEST(atomic_shared_ptr_testing, default_ctor) {
+  atomic_shared_ptr<int> a;
+  EXPECT_TRUE(a.is_lock_free());
+  EXPECT_FALSE(static_cast<bool>(a.load()));
+}
+
+TEST(atomic_shared_ptr_testing, load_store) {
+  test_object::no_new_instances_guard g;
+  atomic_shared_ptr<test_object> a(make_shared<test_object>(1));
+  shared_ptr<test_object> p = a.load();
+  EXPECT_EQ(1, *p);
+  EXPECT_EQ(2, p.use_count());
+
+  a.store(make_shared<test_object>(2));
+  EXPECT_EQ(1, p.use_count());
+  EXPECT_EQ(2, *a.load());
+
+  a = shared_ptr<test_object>();
+  EXPECT_FALSE(static_cast<bool>(a.load()));
+}
+
+TEST(atomic_shared_ptr_testing, exchange) {
+  test_object::no_new_instances_guard g;
+  atomic_shared_ptr<test_object> a(make_shared<test_object>(1));
+  shared_ptr<test_object> old = a.exchange(make_shared<test_object>(2));
+  EXPECT_EQ(1, *old);
+  EXPECT_EQ(1, old.use_count());
+  EXPECT_EQ(2, *a.load());
+}
+
+TEST(atomic_shared_ptr_testing, compare_exchange) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> first = make_shared<test_object>(1);
+  atomic_shared_ptr<test_object> a(first);
+
+  shared_ptr<test_object> expected = make_shared<test_object>(1);
+  EXPECT_FALSE(a.compare_exchange_strong(expected, make_shared<test_object>(2)));
+  EXPECT_EQ(first, expected);
+
+  EXPECT_TRUE(a.compare_exchange_strong(expected, make_shared<test_object>(3)));
+  EXPECT_EQ(3, *a.load());
+  EXPECT_EQ(2, first.use_count());
+  expected.reset();
+  EXPECT_EQ(1, first.use_count());
+}
+
+TEST(atomic_shared_ptr_testing, compare_exchange_aliasing) {
+  shared_ptr<std::pair<int, int>> owner =
+      make_shared<std::pair<int, int>>(1, 2);
+  shared_ptr<int> first(owner, &owner->first);
+  atomic_shared_ptr<int> a(first);
+
+  shared_ptr<int> expected(owner, &owner->second);
+  EXPECT_FALSE(a.compare_exchange_strong(expected, shared_ptr<int>()));
+  EXPECT_EQ(1, *expected);
+  EXPECT_TRUE(a.compare_exchange_strong(expected, shared_ptr<int>()));
+  EXPECT_FALSE(static_cast<bool>(a.load()));
+}
+
+TEST(atomic_shared_ptr_testing, readers_and_writers) {
+  constexpr size_t readers = 3;
+  constexpr size_t writes = 20000;
+  std::atomic<size_t> alive{0};
+
+  struct counted {
+    counted(size_t value, std::atomic<size_t>& alive)
+        : value(value), alive(alive) {
+      alive.fetch_add(1);
+    }
+
+    ~counted() {
+      alive.fetch_sub(1);
+    }
+
+    size_t value;
+    std::atomic<size_t>& alive;
+  };
+
+  {
+    atomic_shared_ptr<counted> a(::make_shared<counted>(0, alive));
+    std::atomic<bool> done{false};
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < readers; ++i) {
+      threads.emplace_back([&] {
+        size_t last = 0;
+        while (!done.load()) {
+          shared_ptr<counted> p = a.load();
+          ASSERT_TRUE(static_cast<bool>(p));
+          EXPECT_LE(last, p->value);
+          last = p->value;
+        }
+      });
+    }
+    threads.emplace_back([&] {
+      for (size_t i = 1; i <= writes; ++i) {
+        if (i % 2 == 0) {
+          a.store(::make_shared<counted>(i, alive));
+        } else {
+          shared_ptr<counted> expected = a.load();
+          while (!a.compare_exchange_weak(expected,
+                                          ::make_shared<counted>(i, alive))) {
+          }
+        }
+      }
+      done.store(true);
+    });
+    for (auto& t : threads) {
+      t.join();
+    }
+    EXPECT_EQ(writes, a.load()->value);
+    EXPECT_EQ(1, alive.load());
+  }
+  EXPECT_EQ(0, alive.load());
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include "shared-ptr.h"
+
+#include <cassert>
+#include <cstdint>
+
+// a shared_ptr<T> slot that many threads may load and replace concurrently
+// without locks, using split reference counts.
+//
+// Every stored value lives in an immutable snapshot node with its own count,
+// and the slot is a single word packing the node address (upper 48 bits) with
+// a local count (lower 16 bits). A reader bumps the local count with one
+// fetch_add, which both picks the node and pins it, copies the shared_ptr out
+// and then gives the borrowed count back. A writer swaps in a new word and
+// moves the local count of the old one into the old node's own count, so
+// readers still holding a borrow release it there instead.
+//
+// At most 65535 threads may be inside one operation on the same slot at once.
+template <typename T>
+class atomic_shared_ptr {
+  struct snapshot {
+    explicit snapshot(shared_ptr<T> value) : value(std::move(value)) {}
+
+    std::atomic<size_t> refs{1};
+    shared_ptr<T> const value;
+  };
+
+  static constexpr unsigned COUNT_BITS = 16;
+  static constexpr uintptr_t COUNT_MASK = (uintptr_t(1) << COUNT_BITS) - 1;
+
+  static_assert(sizeof(uintptr_t) == 8,
+                "the packed word needs 64-bit pointers with 48 used bits");
+
+  mutable std::atomic<uintptr_t> word{0};
+
+  static snapshot* node(uintptr_t w) noexcept {
+    return reinterpret_cast<snapshot*>(w >> COUNT_BITS);
+  }
+
+  static uintptr_t local_count(uintptr_t w) noexcept {
+    return w & COUNT_MASK;
+  }
+
+  static uintptr_t pack(snapshot* s) noexcept {
+    auto address = reinterpret_cast<uintptr_t>(s);
+    assert((address >> (64 - COUNT_BITS)) == 0);
+    return address << COUNT_BITS;
+  }
+
+  static snapshot* make_snapshot(shared_ptr<T> value) {
+    if (shared_ptr_details::access::equivalent(value, shared_ptr<T>())) {
+      return nullptr;
+    }
+    return new snapshot(std::move(value));
+  }
+
+  static void release(snapshot* s) noexcept {
+    if (s && s->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete s;
+    }
+  }
+
+  // pins the current node by bumping the local count
+  uintptr_t borrow() const noexcept {
+    return word.fetch_add(1, std::memory_order_acquire) + 1;
+  }
+
+  // returns a borrowed count to the word if the node is still there,
+  // otherwise a writer has already moved it into the node's own count.
+  // Borrows on an empty slot pin nothing and a store may drop them, so
+  // there the count is only kept from growing.
+  void give_back(snapshot* s) const noexcept {
+    uintptr_t cur = word.load(std::memory_order_relaxed);
+    while (node(cur) == s) {
+      if (!s && local_count(cur) == 0) {
+        return;
+      }
+      if (word.compare_exchange_weak(cur, cur - 1, std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    release(s);
+  }
+
+  // called with a word just swapped out: the slot's own reference is
+  // dropped and every outstanding borrow becomes a reference on the node
+  static void retire(uintptr_t old) noexcept {
+    snapshot* s = node(old);
+    if (!s) {
+      return;
+    }
+    // the release always comes last, so the reader that frees the node
+    // synchronizes with every reader that gave its borrow back to the word
+    uintptr_t borrowed = local_count(old);
+    if (borrowed != 0) {
+      s->refs.fetch_add(borrowed, std::memory_order_relaxed);
+    }
+    release(s);
+  }
+
+public:
+  atomic_shared_ptr() noexcept = default;
+
+  explicit atomic_shared_ptr(shared_ptr<T> desired)
+      : word(pack(make_snapshot(std::move(desired)))) {}
+
+  atomic_shared_ptr(atomic_shared_ptr const&) = delete;
+  atomic_shared_ptr& operator=(atomic_shared_ptr const&) = delete;
+
+  ~atomic_shared_ptr() {
+    retire(word.load(std::memory_order_acquire));
+  }
+
+  bool is_lock_free() const noexcept {
+    return word.is_lock_free();
+  }
+
+  shared_ptr<T> load() const {
+    snapshot* s = node(borrow());
+    shared_ptr<T> result = s ? s->value : shared_ptr<T>();
+    give_back(s);
+    return result;
+  }
+
+  operator shared_ptr<T>() const {
+    return load();
+  }
+
+  void store(shared_ptr<T> desired) {
+    retire(word.exchange(pack(make_snapshot(std::move(desired))),
+                         std::memory_order_acq_rel));
+  }
+
+  atomic_shared_ptr& operator=(shared_ptr<T> desired) {
+    store(std::move(desired));
+    return *this;
+  }
+
+  shared_ptr<T> exchange(shared_ptr<T> desired) {
+    uintptr_t old = word.exchange(pack(make_snapshot(std::move(desired))),
+                                  std::memory_order_acq_rel);
+    snapshot* s = node(old);
+    shared_ptr<T> result = s ? s->value : shared_ptr<T>();
+    retire(old);
+    return result;
+  }
+
+  // succeeds if the stored value shares ownership of the same object as
+  // expected; on failure expected receives the current value
+  bool compare_exchange_strong(shared_ptr<T>& expected, shared_ptr<T> desired) {
+    snapshot* fresh = make_snapshot(std::move(desired));
+    for (;;) {
+      uintptr_t cur = borrow();
+      snapshot* s = node(cur);
+      shared_ptr<T> const& current = s ? s->value : shared_ptr<T>();
+      if (!shared_ptr_details::access::equivalent(current, expected)) {
+        expected = current;
+        give_back(s);
+        release(fresh);
+        return false;
+      }
+      // our own borrow is part of the count that retire() moves over
+      while (node(cur) == s) {
+        if (word.compare_exchange_weak(cur, pack(fresh),
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_relaxed)) {
+          retire(cur);
+          give_back(s);
+          return true;
+        }
+      }
+      give_back(s);
+    }
+  }
+
+  bool compare_exchange_weak(shared_ptr<T>& expected, shared_ptr<T> desired) {
+    return compare_exchange_strong(expected, std::move(desired));
+  }
+};
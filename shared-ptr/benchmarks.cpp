@@ -0,0 +1,291 @@
+#include "atomic-shared-ptr.h"
+#include "deferred-reclaim.h"
+#include "intrusive-ptr.h"
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace {
+
+template <typename Policy>
+shared_ptr<int, Policy> make_int() {
+  if constexpr (std::is_same_v<Policy, local_refcount>) {
+    return make_local_shared<int>(42);
+  } else {
+    return make_shared<int>(42);
+  }
+}
+
+template <typename Policy>
+void bm_make_shared(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<int, Policy> p = make_int<Policy>();
+    benchmark::DoNotOptimize(p);
+  }
+}
+BENCHMARK_TEMPLATE(bm_make_shared, atomic_refcount);
+BENCHMARK_TEMPLATE(bm_make_shared, local_refcount);
+
+// the whole life of a block: create, share, release the last reference
+template <typename Policy>
+void bm_lifecycle_make_shared(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<int, Policy> p = make_int<Policy>();
+    shared_ptr<int, Policy> q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+BENCHMARK_TEMPLATE(bm_lifecycle_make_shared, atomic_refcount);
+BENCHMARK_TEMPLATE(bm_lifecycle_make_shared, local_refcount);
+
+template <typename Policy>
+void bm_lifecycle_ptr_ctor(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<int, Policy> p(new int(42));
+    shared_ptr<int, Policy> q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+BENCHMARK_TEMPLATE(bm_lifecycle_ptr_ctor, atomic_refcount);
+BENCHMARK_TEMPLATE(bm_lifecycle_ptr_ctor, local_refcount);
+
+// short-lived objects, each thread churning through its own
+template <typename Alloc>
+void bm_allocate_shared(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<int> p = ::allocate_shared<int>(Alloc(), 42);
+    benchmark::DoNotOptimize(p);
+  }
+}
+BENCHMARK_TEMPLATE(bm_allocate_shared, std::allocator<int>)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(bm_allocate_shared, pool_allocator<int>)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// shared I/O buffers: one allocation for the block and the bytes, with and
+// without zeroing, against a separately allocated array
+void bm_buffer_make_shared(benchmark::State& state) {
+  size_t n = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    shared_ptr<char[]> p = make_shared<char[]>(n);
+    benchmark::DoNotOptimize(p.get());
+  }
+}
+BENCHMARK(bm_buffer_make_shared)->Arg(64)->Arg(4096);
+
+void bm_buffer_make_shared_for_overwrite(benchmark::State& state) {
+  size_t n = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    shared_ptr<char[]> p = make_shared_for_overwrite<char[]>(n);
+    benchmark::DoNotOptimize(p.get());
+  }
+}
+BENCHMARK(bm_buffer_make_shared_for_overwrite)->Arg(64)->Arg(4096);
+
+void bm_buffer_ptr_ctor(benchmark::State& state) {
+  size_t n = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    shared_ptr<char[]> p(new char[n]);
+    benchmark::DoNotOptimize(p.get());
+  }
+}
+BENCHMARK(bm_buffer_ptr_ctor)->Arg(64)->Arg(4096);
+
+template <typename Policy>
+void bm_copy_destroy(benchmark::State& state) {
+  shared_ptr<int, Policy> p = make_int<Policy>();
+  for (auto _ : state) {
+    shared_ptr<int, Policy> q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+BENCHMARK_TEMPLATE(bm_copy_destroy, atomic_refcount);
+BENCHMARK_TEMPLATE(bm_copy_destroy, local_refcount);
+
+// every thread copies the same pointer, so all of them hit one control block
+void bm_copy_destroy_shared(benchmark::State& state) {
+  static shared_ptr<int> const p = make_shared<int>(42);
+  for (auto _ : state) {
+    shared_ptr<int> q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+BENCHMARK(bm_copy_destroy_shared)->ThreadRange(1, 8)->UseRealTime();
+
+// each thread works on its own pointer: the cost of the atomic instructions
+// without cache line ping-pong, and of plain counters for comparison
+template <typename Policy>
+void bm_copy_destroy_private(benchmark::State& state) {
+  shared_ptr<int, Policy> p = make_int<Policy>();
+  for (auto _ : state) {
+    shared_ptr<int, Policy> q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+BENCHMARK_TEMPLATE(bm_copy_destroy_private, atomic_refcount)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(bm_copy_destroy_private, local_refcount)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+struct counted_payload : ref_counted<counted_payload> {
+  int value = 42;
+};
+
+struct payload {
+  int value = 42;
+};
+
+shared_ptr<payload> make_handle(shared_ptr<payload>*) {
+  return make_shared<payload>();
+}
+
+intrusive_ptr<counted_payload> make_handle(intrusive_ptr<counted_payload>*) {
+  return make_intrusive<counted_payload>();
+}
+
+template <typename Handle>
+void bm_handle_copy_destroy(benchmark::State& state) {
+  Handle p = make_handle(static_cast<Handle*>(nullptr));
+  for (auto _ : state) {
+    Handle q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+BENCHMARK_TEMPLATE(bm_handle_copy_destroy, shared_ptr<payload>);
+BENCHMARK_TEMPLATE(bm_handle_copy_destroy, intrusive_ptr<counted_payload>);
+
+// copies handles to many objects in random order and reads through them,
+// so every step misses the cache
+template <typename Handle>
+void bm_handle_deref_copy(benchmark::State& state) {
+  std::vector<Handle> handles(static_cast<size_t>(state.range(0)));
+  for (auto& h : handles) {
+    h = make_handle(static_cast<Handle*>(nullptr));
+  }
+  std::shuffle(handles.begin(), handles.end(), std::mt19937(42));
+
+  size_t i = 0;
+  for (auto _ : state) {
+    Handle q = handles[i];
+    benchmark::DoNotOptimize(q->value);
+    i = (i + 1) % handles.size();
+  }
+}
+BENCHMARK_TEMPLATE(bm_handle_deref_copy, shared_ptr<payload>)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(bm_handle_deref_copy, intrusive_ptr<counted_payload>)
+    ->Arg(1 << 20);
+
+struct mutex_slot {
+  shared_ptr<payload> load() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return value;
+  }
+
+  void store(shared_ptr<payload> desired) {
+    std::lock_guard<std::mutex> lock(mutex);
+    value.swap(desired);
+  }
+
+  mutable std::mutex mutex;
+  shared_ptr<payload> value = make_shared<payload>();
+};
+
+struct atomic_slot : atomic_shared_ptr<payload> {
+  atomic_slot() : atomic_shared_ptr(make_shared<payload>()) {}
+};
+
+// readers load a published snapshot while thread 0 also republishes it
+// every 1024 reads
+template <typename Slot>
+void bm_publication_read(benchmark::State& state) {
+  static Slot slot;
+  size_t i = 0;
+  for (auto _ : state) {
+    if (state.thread_index() == 0 && ++i % 1024 == 0) {
+      slot.store(make_shared<payload>());
+    }
+    shared_ptr<payload> p = slot.load();
+    benchmark::DoNotOptimize(p->value);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(bm_publication_read, mutex_slot)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(bm_publication_read, atomic_slot)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// a large object graph: the root owns n separately allocated nodes, so the
+// last release runs n destructors and frees n blocks
+struct graph {
+  explicit graph(size_t n) : nodes(n) {
+    for (auto& node : nodes) {
+      node = make_shared<payload>();
+    }
+  }
+
+  std::vector<shared_ptr<payload>> nodes;
+};
+
+enum class release_mode { inline_destroy, drain_later, background_thread };
+
+// the time the releasing thread spends in the last reset(), with building
+// the graph and draining kept out of the measurement. The percentiles of
+// the per-release latencies are reported in microseconds; the iteration
+// count is fixed because a deferred release alone would take millions of
+// graphs to fill the default measuring time.
+template <release_mode Mode>
+void bm_release_latency(benchmark::State& state) {
+  size_t n = static_cast<size_t>(state.range(0));
+  reclaimer r(Mode == release_mode::background_thread
+                  ? reclaimer::mode::background
+                  : reclaimer::mode::manual);
+  std::vector<double> latencies;
+
+  for (auto _ : state) {
+    shared_ptr<graph> g = Mode == release_mode::inline_destroy
+                              ? make_shared<graph>(n)
+                              : make_shared_deferred<graph>(r, n);
+    auto start = std::chrono::steady_clock::now();
+    g.reset();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(elapsed.count());
+    latencies.push_back(elapsed.count() * 1e6);
+    if (Mode == release_mode::drain_later) {
+      r.drain();
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double q) {
+    return latencies[static_cast<size_t>(q * (latencies.size() - 1))];
+  };
+  state.counters["p50_us"] = percentile(0.5);
+  state.counters["p99_us"] = percentile(0.99);
+  state.counters["max_us"] = latencies.back();
+}
+BENCHMARK_TEMPLATE(bm_release_latency, release_mode::inline_destroy)
+    ->Arg(1 << 16)
+    ->Iterations(200)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(bm_release_latency, release_mode::drain_later)
+    ->Arg(1 << 16)
+    ->Iterations(200)
+    ->UseManualTime();
+BENCHMARK_TEMPLATE(bm_release_latency, release_mode::background_thread)
+    ->Arg(1 << 16)
+    ->Iterations(200)
+    ->UseManualTime();
+
+} // namespace
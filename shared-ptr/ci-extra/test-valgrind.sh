@@ -5,3 +5,4 @@ IFS=$' \t\n'
 SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
 
 valgrind --tool=memcheck --gen-suppressions=all --leak-check=full --show-leak-kinds=all --leak-resolution=med --track-origins=yes --vgdb=no --error-exitcode=1 --suppressions="${SCRIPT_DIR}/valgrind.suppressions" --soname-synonyms=somalloc=nouserintercepts cmake-build-RelWithDebInfo/tests
+valgrind --tool=memcheck --gen-suppressions=all --leak-check=full --show-leak-kinds=all --leak-resolution=med --track-origins=yes --vgdb=no --error-exitcode=1 --suppressions="${SCRIPT_DIR}/valgrind.suppressions" --soname-synonyms=somalloc=nouserintercepts cmake-build-RelWithDebInfo/concurrency-tests
@@ -0,0 +1,171 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// the same operations on this shared_ptr and on std::shared_ptr; each
+// benchmark is registered for both, named <operation>/ours and
+// <operation>/std.
+//
+// libstdc++ skips the atomic instructions until the process starts its
+// first thread, so with it the single-threaded std numbers measured before
+// any threaded benchmark are those of plain counters. The threaded runs
+// with one thread compare like with like.
+namespace {
+
+struct ours {
+  template <typename T>
+  using shared = shared_ptr<T>;
+  template <typename T>
+  using weak = weak_ptr<T>;
+
+  template <typename T, typename... Args>
+  static shared<T> make(Args&&... args) {
+    return ::make_shared<T>(std::forward<Args>(args)...);
+  }
+};
+
+struct standard {
+  template <typename T>
+  using shared = std::shared_ptr<T>;
+  template <typename T>
+  using weak = std::weak_ptr<T>;
+
+  template <typename T, typename... Args>
+  static shared<T> make(Args&&... args) {
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  }
+};
+
+struct object {
+  int value = 42;
+};
+
+template <typename Impl>
+void bm_make_shared(benchmark::State& state) {
+  for (auto _ : state) {
+    auto p = Impl::template make<object>();
+    benchmark::DoNotOptimize(p);
+  }
+}
+
+template <typename Impl>
+void bm_ptr_ctor(benchmark::State& state) {
+  for (auto _ : state) {
+    typename Impl::template shared<object> p(new object);
+    benchmark::DoNotOptimize(p);
+  }
+}
+
+// a copy and the release of that copy, which is never the last one
+template <typename Impl>
+void bm_copy(benchmark::State& state) {
+  auto p = Impl::template make<object>();
+  for (auto _ : state) {
+    auto q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+
+// moves there and back, so one iteration is two moves
+template <typename Impl>
+void bm_move(benchmark::State& state) {
+  auto p = Impl::template make<object>();
+  for (auto _ : state) {
+    auto q = std::move(p);
+    benchmark::DoNotOptimize(q);
+    p = std::move(q);
+  }
+}
+
+template <typename Impl>
+void bm_lock(benchmark::State& state) {
+  auto p = Impl::template make<object>();
+  typename Impl::template weak<object> w = p;
+  for (auto _ : state) {
+    auto q = w.lock();
+    benchmark::DoNotOptimize(q);
+  }
+}
+
+template <typename Impl>
+void bm_lock_expired(benchmark::State& state) {
+  typename Impl::template weak<object> w = Impl::template make<object>();
+  for (auto _ : state) {
+    auto q = w.lock();
+    benchmark::DoNotOptimize(q);
+  }
+}
+
+// releasing the last reference alone; the pointers are made in batches
+// with the timer paused
+template <typename Impl>
+void bm_destroy_last(benchmark::State& state) {
+  constexpr size_t BATCH = 1024;
+  std::vector<typename Impl::template shared<object>> batch(BATCH);
+  size_t i = BATCH;
+  for (auto _ : state) {
+    if (i == BATCH) {
+      state.PauseTiming();
+      for (auto& p : batch) {
+        p = Impl::template make<object>();
+      }
+      i = 0;
+      state.ResumeTiming();
+    }
+    batch[i++].reset();
+  }
+}
+
+// threads copy one pointer, so all of them hit the same control block
+template <typename Impl>
+void bm_copy_contended(benchmark::State& state) {
+  static auto const p = Impl::template make<object>();
+  for (auto _ : state) {
+    auto q = p;
+    benchmark::DoNotOptimize(q);
+  }
+}
+
+template <typename Impl>
+void bm_lock_contended(benchmark::State& state) {
+  static auto const p = Impl::template make<object>();
+  static typename Impl::template weak<object> const w = p;
+  for (auto _ : state) {
+    auto q = w.lock();
+    benchmark::DoNotOptimize(q);
+  }
+}
+
+#define COMPARE(bm)                                                            \
+  BENCHMARK_TEMPLATE(bm, ours)->Name(#bm "/ours");                             \
+  BENCHMARK_TEMPLATE(bm, standard)->Name(#bm "/std")
+
+#define COMPARE_THREADED(bm)                                                   \
+  BENCHMARK_TEMPLATE(bm, ours)                                                 \
+      ->Name(#bm "/ours")                                                      \
+      ->ThreadRange(1, 8)                                                      \
+      ->UseRealTime();                                                         \
+  BENCHMARK_TEMPLATE(bm, standard)                                             \
+      ->Name(#bm "/std")                                                       \
+      ->ThreadRange(1, 8)                                                      \
+      ->UseRealTime()
+
+COMPARE(bm_make_shared);
+COMPARE(bm_ptr_ctor);
+COMPARE(bm_copy);
+COMPARE(bm_move);
+COMPARE(bm_lock);
+COMPARE(bm_lock_expired);
+COMPARE(bm_destroy_last);
+
+// each thread on its own objects: allocator and atomic cost without sharing
+COMPARE_THREADED(bm_make_shared);
+COMPARE_THREADED(bm_copy);
+
+COMPARE_THREADED(bm_copy_contended);
+COMPARE_THREADED(bm_lock_contended);
+
+} // namespace
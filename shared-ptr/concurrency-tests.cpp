@@ -0,0 +1,174 @@
+#include "cycle-collector.h"
+#include "shared-ptr.h"
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr size_t THREADS = 4;
+constexpr size_t ITERATIONS = 100000;
+
+struct destruction_counter {
+  explicit destruction_counter(std::atomic<size_t>& destroyed)
+      : destroyed(destroyed) {}
+
+  ~destruction_counter() {
+    destroyed.fetch_add(1);
+  }
+
+  std::atomic<size_t>& destroyed;
+};
+
+// every thread fills its own slot without synchronization; the destructor
+// reads all of them, which is only race-free if the final release
+// synchronizes with the earlier ones
+struct per_thread_slots {
+  explicit per_thread_slots(bool& checked) : checked(checked) {}
+
+  ~per_thread_slots() {
+    for (size_t i = 0; i < THREADS; ++i) {
+      EXPECT_EQ(i + 1, slots[i]);
+    }
+    checked = true;
+  }
+
+  std::array<size_t, THREADS> slots{};
+  bool& checked;
+};
+} // namespace
+
+TEST(shared_ptr_concurrency, copies_across_threads) {
+  std::atomic<size_t> destroyed{0};
+  shared_ptr<destruction_counter> p =
+      ::make_shared<destruction_counter>(destroyed);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < THREADS; ++t) {
+    threads.emplace_back([p] {
+      for (size_t i = 0; i < ITERATIONS; ++i) {
+        shared_ptr<destruction_counter> q = p;
+        weak_ptr<destruction_counter> w = q;
+        shared_ptr<destruction_counter> r = std::move(q);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(1, p.use_count());
+  EXPECT_EQ(0, destroyed.load());
+  p.reset();
+  EXPECT_EQ(1, destroyed.load());
+}
+
+TEST(shared_ptr_concurrency, last_release_on_any_thread) {
+  for (size_t round = 0; round < 100; ++round) {
+    bool checked = false;
+    {
+      shared_ptr<per_thread_slots> p(new per_thread_slots(checked));
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([q = p, t]() mutable {
+          q->slots[t] = t + 1;
+          q.reset();
+        });
+      }
+      p.reset();
+      for (auto& t : threads) {
+        t.join();
+      }
+    }
+    EXPECT_TRUE(checked);
+  }
+}
+
+namespace {
+struct guarded {
+  ~guarded() {
+    alive.store(false);
+  }
+
+  std::atomic<bool> alive{true};
+};
+} // namespace
+
+// lock() on other threads races with the last release; a pointer it
+// returns must never refer to a destroyed object
+TEST(shared_ptr_concurrency, lock_races_last_release) {
+  for (size_t round = 0; round < 1000; ++round) {
+    shared_ptr<guarded> p = ::make_shared<guarded>();
+    weak_ptr<guarded> w = p;
+    std::atomic<bool> stale{false};
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS; ++t) {
+      threads.emplace_back([w, &stale] {
+        for (size_t i = 0; i < 100; ++i) {
+          shared_ptr<guarded> q = w.lock();
+          if (q && !q->alive.load()) {
+            stale.store(true);
+          }
+          if (w.expired()) {
+            EXPECT_FALSE(static_cast<bool>(w.lock()));
+          }
+        }
+      });
+    }
+    p.reset();
+    for (auto& t : threads) {
+      t.join();
+    }
+    EXPECT_FALSE(stale.load());
+    EXPECT_TRUE(w.expired());
+  }
+}
+
+namespace {
+struct collectable_counter {
+  explicit collectable_counter(std::atomic<size_t>& destroyed)
+      : destroyed(destroyed) {}
+
+  ~collectable_counter() {
+    destroyed.fetch_add(1);
+  }
+
+  void trace(cycle_tracer&) {}
+
+  std::atomic<size_t>& destroyed;
+};
+} // namespace
+
+// copies of a tracked object are released on several threads at once.
+// Every release but the last queues the block as a possible root, which
+// has to happen before the last release can free the block.
+TEST(shared_ptr_concurrency, concurrent_collectable_releases) {
+  cycle_collector c;
+  std::atomic<size_t> destroyed{0};
+  for (size_t round = 0; round < 1000; ++round) {
+    shared_ptr<collectable_counter> p =
+        make_shared_collectable<collectable_counter>(c, destroyed);
+    std::atomic<size_t> ready{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS; ++t) {
+      threads.emplace_back([q = p, &ready]() mutable {
+        ready.fetch_add(1);
+        while (ready.load() != THREADS) {
+          std::this_thread::yield();
+        }
+        q.reset();
+      });
+    }
+    p.reset();
+    for (auto& t : threads) {
+      t.join();
+    }
+    EXPECT_EQ(round + 1, destroyed.load());
+    // drops the blocks queued by releases that turned out to be the last
+    c.collect();
+  }
+  EXPECT_EQ(0, c.pending());
+}
@@ -0,0 +1,157 @@
+#include "cycle-collector.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+struct graph_node {
+  explicit graph_node(int value) : value(value) {}
+
+  void trace(cycle_tracer& tracer) const {
+    for (auto const& edge : edges) {
+      tracer(edge);
+    }
+  }
+
+  test_object value;
+  std::vector<shared_ptr<graph_node>> edges;
+  shared_ptr<test_object> untracked;
+};
+
+// looks at its peer from the destructor, through a weak_ptr
+struct watching_node {
+  void trace(cycle_tracer& tracer) const {
+    tracer(next);
+  }
+
+  ~watching_node() {
+    shared_ptr<watching_node> locked = peer.lock();
+    peer_alive.push_back(static_cast<bool>(locked));
+    peer_expired.push_back(peer.expired());
+  }
+
+  shared_ptr<watching_node> next;
+  weak_ptr<watching_node> peer;
+
+  static inline std::vector<bool> peer_alive;
+  static inline std::vector<bool> peer_expired;
+};
+} // namespace
+
+TEST(cycle_collector_testing, self_cycle) {
+  test_object::no_new_instances_guard g;
+  cycle_collector c;
+  shared_ptr<graph_node> p = make_shared_collectable<graph_node>(c, 1);
+  p->edges.push_back(p);
+  EXPECT_EQ(2, p.use_count());
+
+  p.reset();
+  EXPECT_EQ(1, c.pending());
+  EXPECT_EQ(1, c.collect());
+  EXPECT_EQ(0, c.pending());
+  g.expect_no_instances();
+}
+
+TEST(cycle_collector_testing, external_reference_keeps_cycle) {
+  test_object::no_new_instances_guard g;
+  cycle_collector c;
+  shared_ptr<graph_node> a = make_shared_collectable<graph_node>(c, 1);
+  {
+    shared_ptr<graph_node> b = make_shared_collectable<graph_node>(c, 2);
+    a->edges.push_back(b);
+    b->edges.push_back(a);
+  }
+  EXPECT_EQ(0, c.collect());
+  EXPECT_EQ(2, a->edges[0]->value);
+
+  a.reset();
+  EXPECT_EQ(2, c.collect());
+  g.expect_no_instances();
+}
+
+TEST(cycle_collector_testing, reachable_from_cycle) {
+  test_object::no_new_instances_guard g;
+  cycle_collector c;
+  shared_ptr<graph_node> a = make_shared_collectable<graph_node>(c, 1);
+  shared_ptr<graph_node> b = make_shared_collectable<graph_node>(c, 2);
+  a->edges.push_back(b);
+  b->edges.push_back(a);
+  a->edges.push_back(make_shared_collectable<graph_node>(c, 3));
+  a->untracked = make_shared<test_object>(4);
+
+  a.reset();
+  b.reset();
+  EXPECT_EQ(3, c.collect());
+  g.expect_no_instances();
+}
+
+TEST(cycle_collector_testing, weak_ptr_to_cycle) {
+  test_object::no_new_instances_guard g;
+  cycle_collector c;
+  shared_ptr<graph_node> p = make_shared_collectable<graph_node>(c, 1);
+  p->edges.push_back(p);
+  weak_ptr<graph_node> w = p;
+
+  p.reset();
+  EXPECT_TRUE(static_cast<bool>(w.lock()));
+  EXPECT_EQ(1, c.collect());
+  EXPECT_FALSE(static_cast<bool>(w.lock()));
+  g.expect_no_instances();
+}
+
+TEST(cycle_collector_testing, weak_ptr_in_destructor_of_cycle) {
+  cycle_collector c;
+  {
+    shared_ptr<watching_node> a = make_shared_collectable<watching_node>(c);
+    shared_ptr<watching_node> b = make_shared_collectable<watching_node>(c);
+    a->next = b;
+    b->next = a;
+    a->peer = b;
+    b->peer = a;
+  }
+  EXPECT_EQ(2, c.collect());
+  EXPECT_EQ((std::vector<bool>{false, false}), watching_node::peer_alive);
+  EXPECT_EQ((std::vector<bool>{true, true}), watching_node::peer_expired);
+}
+
+TEST(cycle_collector_testing, acyclic_objects_released_without_collect) {
+  test_object::no_new_instances_guard g;
+  cycle_collector c;
+  shared_ptr<graph_node> a = make_shared_collectable<graph_node>(c, 1);
+  a->edges.push_back(make_shared_collectable<graph_node>(c, 2));
+  shared_ptr<graph_node> b = a->edges[0];
+
+  a.reset();
+  b.reset();
+  g.expect_no_instances();
+  EXPECT_EQ(0, c.collect());
+}
+
+TEST(cycle_collector_testing, long_ring) {
+  test_object::no_new_instances_guard g;
+  cycle_collector c;
+  constexpr int LENGTH = 100000;
+  shared_ptr<graph_node> first = make_shared_collectable<graph_node>(c, 0);
+  shared_ptr<graph_node> last = first;
+  for (int i = 1; i < LENGTH; ++i) {
+    shared_ptr<graph_node> next = make_shared_collectable<graph_node>(c, i);
+    last->edges.push_back(next);
+    last = next;
+  }
+  last->edges.push_back(first);
+  last.reset();
+  EXPECT_EQ(0, c.collect());
+
+  first.reset();
+  EXPECT_EQ(LENGTH, c.collect());
+  g.expect_no_instances();
+}
+
+TEST(cycle_collector_testing, only_collectable_blocks_tracked) {
+  cycle_collector c;
+  shared_ptr<graph_node> p = make_shared<graph_node>(1);
+  shared_ptr<graph_node> q = make_shared_collectable<graph_node>(c, 2);
+  EXPECT_FALSE(shared_ptr_details::access::block_of(p)->tracked());
+  EXPECT_TRUE(shared_ptr_details::access::block_of(q)->tracked());
+}
@@ -0,0 +1,325 @@
+#pragma once
+#include "shared-ptr.h"
+
+#include <atomic>
+#include <vector>
+
+class cycle_collector;
+class cycle_tracer;
+
+namespace shared_ptr_details {
+// the part of a collectable block the collector works with. A block is
+// queued as a candidate root by every release that may leave it alive,
+// before the reference is given up; the queue holds a weak reference so
+// the block outlives the object if the release turns out to be the last.
+class collectable_block_base : public control_block<atomic_refcount> {
+  friend class ::cycle_collector;
+
+  enum class color { black, gray, white };
+
+  using tracer_t = void (*)(collectable_block_base*, cycle_tracer&);
+  using destructor_t = void (*)(collectable_block_base*) noexcept;
+
+  cycle_collector* owner;
+  tracer_t trace_children;
+  destructor_t destroy_object;
+
+  collectable_block_base* next_candidate{nullptr};
+  std::atomic<bool> buffered{false};
+  // set by the collector before it destroys the object of a garbage cycle,
+  // so the releases that follow don't queue it again
+  bool disposed{false};
+  color mark{color::black};
+  size_t trial_cnt{0};
+
+protected:
+  collectable_block_base(manager_t manager, cycle_collector& owner,
+                         tracer_t trace_children,
+                         destructor_t destroy_object) noexcept
+      : control_block<atomic_refcount>(manager, true), owner(&owner),
+        trace_children(trace_children), destroy_object(destroy_object) {}
+
+  ~collectable_block_base() = default;
+
+  // called from the manager with every operation but destroy
+  static void release(collectable_block_base* self, operation op) noexcept;
+};
+} // namespace shared_ptr_details
+
+// handed to T::trace, which passes it every shared_ptr member that may lead
+// back to the object. Pointers to objects not made by
+// make_shared_collectable are skipped, so cycles through them aren't found.
+class cycle_tracer {
+  std::vector<shared_ptr_details::collectable_block_base*>& children;
+
+  friend class cycle_collector;
+
+  explicit cycle_tracer(
+      std::vector<shared_ptr_details::collectable_block_base*>& children)
+      : children(children) {}
+
+public:
+  template <typename U>
+  void operator()(shared_ptr<U> const& p) {
+    auto* block = shared_ptr_details::access::block_of(p);
+    if (block && block->tracked()) {
+      children.push_back(
+          static_cast<shared_ptr_details::collectable_block_base*>(block));
+    }
+  }
+};
+
+// finds and frees reference cycles among objects made with
+// make_shared_collectable, by trial deletion: starting from objects whose
+// count dropped without reaching zero, it subtracts the references the
+// candidates' subgraph holds on itself, and whatever is left without
+// outside references is garbage.
+//
+// Releases may happen on any thread and only queue candidates. collect()
+// must run while no other thread changes the tracked objects or their
+// pointers, e.g. at a safe point of the thread that owns the graph. The
+// collector must outlive every object made with it.
+class cycle_collector {
+  using block = shared_ptr_details::collectable_block_base;
+  using color = block::color;
+
+  friend class shared_ptr_details::collectable_block_base;
+
+  std::atomic<block*> candidates{nullptr};
+  std::atomic<size_t> candidate_cnt{0};
+
+  void add_candidate(block* b) noexcept {
+    if (b->buffered.exchange(true, std::memory_order_relaxed)) {
+      return;
+    }
+    b->inc_weak();
+    block* old = candidates.load(std::memory_order_relaxed);
+    do {
+      b->next_candidate = old;
+    } while (!candidates.compare_exchange_weak(old, b,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+    candidate_cnt.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static void children_of(block* b, std::vector<block*>& out) {
+    out.clear();
+    cycle_tracer tracer(out);
+    b->trace_children(b, tracer);
+  }
+
+  // colors everything reachable from root gray, taking every internal
+  // reference off the trial counts
+  static void mark_gray(block* root, std::vector<block*>& work,
+                        std::vector<block*>& children) {
+    if (root->mark == color::gray) {
+      return;
+    }
+    root->mark = color::gray;
+    root->trial_cnt = root->get_strong_cnt();
+    work.push_back(root);
+    while (!work.empty()) {
+      block* b = work.back();
+      work.pop_back();
+      children_of(b, children);
+      for (block* c : children) {
+        if (c->mark != color::gray) {
+          c->mark = color::gray;
+          c->trial_cnt = c->get_strong_cnt();
+          work.push_back(c);
+        }
+        c->trial_cnt -= 1;
+      }
+    }
+  }
+
+  // whatever a block with outside references reaches is alive
+  static void scan_black(block* root, std::vector<block*>& work,
+                         std::vector<block*>& children) {
+    root->mark = color::black;
+    work.push_back(root);
+    while (!work.empty()) {
+      block* b = work.back();
+      work.pop_back();
+      children_of(b, children);
+      for (block* c : children) {
+        if (c->mark != color::black) {
+          c->mark = color::black;
+          work.push_back(c);
+        }
+      }
+    }
+  }
+
+  static void scan(block* root, std::vector<block*>& work,
+                   std::vector<block*>& children) {
+    std::vector<block*> pending{root};
+    while (!pending.empty()) {
+      block* b = pending.back();
+      pending.pop_back();
+      if (b->mark != color::gray) {
+        continue;
+      }
+      if (b->trial_cnt > 0) {
+        scan_black(b, work, children);
+        continue;
+      }
+      b->mark = color::white;
+      children_of(b, children);
+      pending.insert(pending.end(), children.begin(), children.end());
+    }
+  }
+
+  static void collect_white(block* root, std::vector<block*>& garbage,
+                            std::vector<block*>& children) {
+    if (root->mark != color::white) {
+      return;
+    }
+    root->mark = color::black;
+    size_t first = garbage.size();
+    garbage.push_back(root);
+    for (size_t i = first; i < garbage.size(); ++i) {
+      children_of(garbage[i], children);
+      for (block* c : children) {
+        if (c->mark == color::white) {
+          c->mark = color::black;
+          garbage.push_back(c);
+        }
+      }
+    }
+  }
+
+public:
+  cycle_collector() noexcept = default;
+
+  cycle_collector(cycle_collector const&) = delete;
+  cycle_collector& operator=(cycle_collector const&) = delete;
+
+  ~cycle_collector() {
+    collect();
+  }
+
+  // candidates queued since the last collection; a caller that collects
+  // periodically can use it to skip collections that have nothing to do
+  size_t pending() const noexcept {
+    return candidate_cnt.load(std::memory_order_relaxed);
+  }
+
+  // examines every queued candidate in one batch and frees the unreachable
+  // cycles among them; returns the number of objects freed
+  size_t collect() {
+    std::vector<block*> roots;
+    for (block* b = candidates.exchange(nullptr, std::memory_order_acquire);
+         b;) {
+      block* next = b->next_candidate;
+      candidate_cnt.fetch_sub(1, std::memory_order_relaxed);
+      b->buffered.store(false, std::memory_order_relaxed);
+      // queued by a release that turned out to be the last one
+      if (b->get_strong_cnt() == 0) {
+        b->dec_weak();
+      } else {
+        roots.push_back(b);
+      }
+      b = next;
+    }
+
+    std::vector<block*> work;
+    std::vector<block*> children;
+    for (block* b : roots) {
+      mark_gray(b, work, children);
+    }
+    for (block* b : roots) {
+      scan(b, work, children);
+    }
+    std::vector<block*> garbage;
+    for (block* b : roots) {
+      collect_white(b, garbage, children);
+    }
+
+    // the garbage dies before any destructor runs, so weak_ptrs to it no
+    // longer lock, and the references it holds on itself are released
+    // without destroying anything a second time
+    for (block* b : garbage) {
+      b->disposed = true;
+      b->begin_collect();
+    }
+    for (block* b : garbage) {
+      b->destroy_object(b);
+    }
+    for (block* b : garbage) {
+      b->end_collect();
+    }
+    for (block* b : roots) {
+      b->dec_weak();
+    }
+    return garbage.size();
+  }
+};
+
+namespace shared_ptr_details {
+inline void collectable_block_base::release(collectable_block_base* self,
+                                            operation op) noexcept {
+  if (self->disposed) {
+    return;
+  }
+  if (op == operation::possible_root) {
+    self->owner->add_candidate(self);
+  } else {
+    self->destroy_object(self);
+  }
+}
+
+template <typename T, typename Alloc>
+class collectable_block : public collectable_block_base,
+                          public allocator_holder<Alloc> {
+  std::aligned_storage_t<sizeof(T), alignof(T)> obj;
+
+  static void manage(control_block<atomic_refcount>* base,
+                     operation op) noexcept {
+    auto* self = static_cast<collectable_block*>(base);
+    if (op != operation::destroy) {
+      release(self, op);
+    }
+    if (op == operation::destroy || op == operation::dispose_and_destroy) {
+      destroy_block(self);
+    }
+  }
+
+  static void trace(collectable_block_base* base, cycle_tracer& tracer) {
+    static_cast<collectable_block*>(base)->get()->trace(tracer);
+  }
+
+  static void destroy(collectable_block_base* base) noexcept {
+    static_cast<collectable_block*>(base)->get()->~T();
+  }
+
+public:
+  using allocator_type = Alloc;
+
+  template <typename... Args>
+  collectable_block(Alloc const& alloc, cycle_collector& owner,
+                    Args&&... args)
+      : collectable_block_base(&manage, owner, &trace, &destroy),
+        allocator_holder<Alloc>(alloc) {
+    new (&obj) T(std::forward<Args>(args)...);
+    this->template instrument<T>(sizeof(collectable_block));
+  }
+
+  T* get() noexcept {
+    return reinterpret_cast<T*>(&obj);
+  }
+};
+} // namespace shared_ptr_details
+
+// like make_shared, but cycles of such objects are freed by c. T provides
+// void trace(cycle_tracer&) that passes the tracer each of its shared_ptr
+// members.
+template <typename T, typename... Args>
+shared_ptr<T> make_shared_collectable(cycle_collector& c, Args&&... args) {
+  auto* block = shared_ptr_details::create_block<
+      shared_ptr_details::collectable_block<T, std::allocator<T>>>(
+      std::allocator<T>(), c, std::forward<Args>(args)...);
+  shared_ptr_details::access::link_shared_from_this(block->get(), block,
+                                                    block->get());
+  return shared_ptr_details::access::make_shared<T>(block, block->get());
+}
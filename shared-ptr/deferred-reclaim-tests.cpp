@@ -0,0 +1,147 @@
+#include "deferred-reclaim.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+struct destruction_counter {
+  explicit destruction_counter(std::atomic<size_t>& destroyed)
+      : destroyed(destroyed) {}
+
+  ~destruction_counter() {
+    destroyed.fetch_add(1);
+  }
+
+  std::atomic<size_t>& destroyed;
+};
+} // namespace
+
+TEST(deferred_reclaim_testing, destroyed_on_drain) {
+  test_object::no_new_instances_guard g;
+  reclaimer r;
+  shared_ptr<test_object> p = make_shared_deferred<test_object>(r, 42);
+  EXPECT_EQ(42, *p);
+  EXPECT_EQ(1, p.use_count());
+
+  p.reset();
+  EXPECT_EQ(1, r.drain());
+  g.expect_no_instances();
+  EXPECT_EQ(0, r.drain());
+}
+
+TEST(deferred_reclaim_testing, stays_alive_until_drain) {
+  std::atomic<size_t> destroyed{0};
+  reclaimer r;
+  make_shared_deferred<destruction_counter>(r, destroyed);
+  EXPECT_EQ(0, destroyed.load());
+  EXPECT_EQ(1, r.drain());
+  EXPECT_EQ(1, destroyed.load());
+}
+
+TEST(deferred_reclaim_testing, weak_ptr_expires_before_drain) {
+  test_object::no_new_instances_guard g;
+  reclaimer r;
+  shared_ptr<test_object> p = make_shared_deferred<test_object>(r, 42);
+  weak_ptr<test_object> w = p;
+
+  p.reset();
+  EXPECT_FALSE(static_cast<bool>(w.lock()));
+  EXPECT_EQ(1, r.drain());
+  g.expect_no_instances();
+}
+
+TEST(deferred_reclaim_testing, weak_ptr_released_before_drain) {
+  test_object::no_new_instances_guard g;
+  reclaimer r;
+  shared_ptr<test_object> p = make_shared_deferred<test_object>(r, 42);
+  weak_ptr<test_object> w = p;
+
+  p.reset();
+  w = weak_ptr<test_object>();
+  EXPECT_EQ(1, r.drain());
+  g.expect_no_instances();
+}
+
+namespace {
+struct chain_link {
+  shared_ptr<chain_link> next;
+  test_object payload{0};
+};
+} // namespace
+
+TEST(deferred_reclaim_testing, drain_follows_cascades) {
+  test_object::no_new_instances_guard g;
+  reclaimer r;
+  shared_ptr<chain_link> head;
+  for (int i = 0; i < 3; ++i) {
+    shared_ptr<chain_link> link = make_shared_deferred<chain_link>(r);
+    link->next = head;
+    head = link;
+  }
+
+  head.reset();
+  EXPECT_EQ(3, r.drain());
+  g.expect_no_instances();
+}
+
+TEST(deferred_reclaim_testing, reclaimer_dtor_drains) {
+  test_object::no_new_instances_guard g;
+  {
+    reclaimer r;
+    make_shared_deferred<test_object>(r, 1);
+    make_shared_deferred<test_object>(r, 2);
+  }
+  g.expect_no_instances();
+}
+
+namespace {
+struct thread_recorder {
+  explicit thread_recorder(std::atomic<std::thread::id>& destroyed_on)
+      : destroyed_on(destroyed_on) {}
+
+  ~thread_recorder() {
+    destroyed_on = std::this_thread::get_id();
+  }
+
+  std::atomic<std::thread::id>& destroyed_on;
+};
+} // namespace
+
+TEST(deferred_reclaim_testing, background_thread) {
+  std::atomic<std::thread::id> destroyed_on{std::thread::id()};
+  reclaimer r(reclaimer::mode::background);
+  make_shared_deferred<thread_recorder>(r, destroyed_on);
+  while (destroyed_on.load() == std::thread::id()) {
+    std::this_thread::yield();
+  }
+  EXPECT_NE(std::this_thread::get_id(), destroyed_on.load());
+}
+
+TEST(deferred_reclaim_testing, concurrent_releases) {
+  constexpr size_t THREADS = 4;
+  constexpr size_t ITERATIONS = 10000;
+  std::atomic<size_t> destroyed{0};
+  {
+    reclaimer r(reclaimer::mode::background);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < THREADS; ++i) {
+      threads.emplace_back([&] {
+        for (size_t j = 0; j < ITERATIONS; ++j) {
+          shared_ptr<destruction_counter> p =
+              make_shared_deferred<destruction_counter>(r, destroyed);
+          weak_ptr<destruction_counter> w = p;
+          shared_ptr<destruction_counter> q = p;
+          p.reset();
+          q.reset();
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  EXPECT_EQ(THREADS * ITERATIONS, destroyed.load());
+}
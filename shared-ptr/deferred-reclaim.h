@@ -0,0 +1,184 @@
+#pragma once
+#include "shared-ptr.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// a queue of objects whose destruction was taken off the thread that
+// released them. Retiring is a single lock-free push; the objects are
+// destroyed, oldest first, either by drain() at a point the owner chooses or
+// by a background thread.
+//
+// The reclaimer must outlive every pointer made with it; whatever is still
+// queued when it is destroyed is destroyed there.
+class reclaimer {
+public:
+  // lives inside the retired object's own memory, so retiring never
+  // allocates
+  struct node {
+    node* next{nullptr};
+    void (*reclaim)(node*) noexcept{nullptr};
+  };
+
+  enum class mode { manual, background };
+
+private:
+  std::atomic<node*> head{nullptr};
+
+  std::mutex m;
+  std::condition_variable wake;
+  bool stopping{false};
+  std::thread worker;
+
+  void run() {
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(m);
+        wake.wait(lock, [this] {
+          return stopping || head.load(std::memory_order_relaxed);
+        });
+        if (stopping) {
+          return;
+        }
+      }
+      drain();
+    }
+  }
+
+public:
+  explicit reclaimer(mode kind = mode::manual) {
+    if (kind == mode::background) {
+      worker = std::thread([this] { run(); });
+    }
+  }
+
+  reclaimer(reclaimer const&) = delete;
+  reclaimer& operator=(reclaimer const&) = delete;
+
+  ~reclaimer() {
+    if (worker.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(m);
+        stopping = true;
+      }
+      wake.notify_one();
+      worker.join();
+    }
+    drain();
+  }
+
+  void retire(node* n) noexcept {
+    node* old = head.load(std::memory_order_relaxed);
+    do {
+      n->next = old;
+    } while (!head.compare_exchange_weak(old, n, std::memory_order_release,
+                                         std::memory_order_relaxed));
+    // only the push onto an empty queue can find the worker asleep; taking
+    // the lock makes sure it is either waiting or yet to look at the queue
+    if (!old && worker.joinable()) {
+      { std::lock_guard<std::mutex> lock(m); }
+      wake.notify_one();
+    }
+  }
+
+  // destroys everything retired so far on the calling thread, including
+  // whatever those destructors retire in turn; returns how many objects
+  // were destroyed
+  size_t drain() noexcept {
+    size_t reclaimed = 0;
+    while (node* list = head.exchange(nullptr, std::memory_order_acquire)) {
+      node* oldest = nullptr;
+      while (list) {
+        node* next = list->next;
+        list->next = oldest;
+        oldest = list;
+        list = next;
+      }
+      while (oldest) {
+        node* next = oldest->next;
+        oldest->reclaim(oldest);
+        oldest = next;
+        ++reclaimed;
+      }
+    }
+    return reclaimed;
+  }
+};
+
+namespace shared_ptr_details {
+// like obj_block, but disposing the object only queues the block on a
+// reclaimer. If weak references remain, the queued block holds one more of
+// them so the memory stays around until the object has been destroyed.
+template <typename T, typename Alloc>
+class deferred_block : public control_block<atomic_refcount>,
+                       public allocator_holder<Alloc>,
+                       private reclaimer::node {
+  using operation = control_block<atomic_refcount>::operation;
+
+  std::aligned_storage_t<sizeof(T), alignof(T)> obj;
+  reclaimer* owner;
+  bool last_reference{false};
+
+  static void manage(control_block<atomic_refcount>* block,
+                     operation op) noexcept {
+    auto* self = static_cast<deferred_block*>(block);
+    if (op == operation::destroy) {
+      destroy_block(self);
+      return;
+    }
+    if (op == operation::dispose) {
+      self->inc_weak();
+    } else {
+      self->last_reference = true;
+    }
+    self->owner->retire(self);
+  }
+
+  static void reclaim_node(reclaimer::node* n) noexcept {
+    auto* self = static_cast<deferred_block*>(n);
+    self->get()->~T();
+    if (self->last_reference) {
+      destroy_block(self);
+    } else {
+      self->dec_weak();
+    }
+  }
+
+public:
+  using allocator_type = Alloc;
+
+  template <typename... Args>
+  deferred_block(Alloc const& alloc, reclaimer& owner, Args&&... args)
+      : control_block<atomic_refcount>(&manage),
+        allocator_holder<Alloc>(alloc), owner(&owner) {
+    this->reclaim = &reclaim_node;
+    new (&obj) T(std::forward<Args>(args)...);
+    this->template instrument<T>(sizeof(deferred_block));
+  }
+
+  T* get() noexcept {
+    return reinterpret_cast<T*>(&obj);
+  }
+};
+} // namespace shared_ptr_details
+
+// like make_shared, but the last owner hands the object to r instead of
+// destroying it; weak_ptrs expire at that point as usual
+template <typename T, typename Alloc, typename... Args>
+shared_ptr<T> allocate_shared_deferred(Alloc const& alloc, reclaimer& r,
+                                       Args&&... args) {
+  auto* block = shared_ptr_details::create_block<
+      shared_ptr_details::deferred_block<T, Alloc>>(
+      alloc, r, std::forward<Args>(args)...);
+  shared_ptr_details::access::link_shared_from_this(block->get(), block,
+                                                    block->get());
+  return shared_ptr_details::access::make_shared<T>(block, block->get());
+}
+
+template <typename T, typename... Args>
+shared_ptr<T> make_shared_deferred(reclaimer& r, Args&&... args) {
+  return allocate_shared_deferred<T>(std::allocator<T>(), r,
+                                     std::forward<Args>(args)...);
+}
@@ -0,0 +1,111 @@
+#include "shared-ptr.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <typeinfo>
+
+#ifndef SHARED_PTR_INSTRUMENTATION
+#error "build these tests and shared-ptr.cpp with SHARED_PTR_INSTRUMENTATION"
+#endif
+
+using shared_ptr_instrumentation::stats_of;
+
+// every test has types of its own, since the counters live for the whole
+// program
+TEST(instrumentation_testing, live_objects) {
+  struct widget {
+    char payload[100];
+  };
+  EXPECT_EQ(0, stats_of<widget>().live);
+
+  shared_ptr<widget> a = make_shared<widget>();
+  shared_ptr<widget> b(new widget);
+  auto stats = stats_of<widget>();
+  EXPECT_EQ(2, stats.live);
+  EXPECT_EQ(2, stats.peak);
+  EXPECT_GE(stats.bytes, 2 * sizeof(widget));
+
+  a.reset();
+  stats = stats_of<widget>();
+  EXPECT_EQ(1, stats.live);
+  EXPECT_EQ(2, stats.peak);
+
+  b.reset();
+  stats = stats_of<widget>();
+  EXPECT_EQ(0, stats.live);
+  EXPECT_EQ(0, stats.bytes);
+  EXPECT_EQ(2, stats.peak);
+}
+
+TEST(instrumentation_testing, refcount_traffic) {
+  struct gadget {};
+  {
+    shared_ptr<gadget> p = make_shared<gadget>();
+    shared_ptr<gadget> q = p;
+    shared_ptr<gadget> r = std::move(q);
+    weak_ptr<gadget> w = p;
+    weak_ptr<gadget> v = w;
+  }
+  auto stats = stats_of<gadget>();
+  EXPECT_EQ(2, stats.strong_increments);
+  EXPECT_EQ(2, stats.strong_decrements);
+  EXPECT_EQ(2, stats.weak_increments);
+  EXPECT_EQ(2, stats.weak_decrements);
+
+  // the block of a raw-pointer constructor takes its first reference itself
+  struct owned_gadget {};
+  {
+    shared_ptr<owned_gadget> p(new owned_gadget);
+    shared_ptr<owned_gadget> q = p;
+    weak_ptr<owned_gadget> w = q;
+  }
+  stats = stats_of<owned_gadget>();
+  EXPECT_EQ(2, stats.strong_increments);
+  EXPECT_EQ(2, stats.strong_decrements);
+  EXPECT_EQ(1, stats.weak_increments);
+  EXPECT_EQ(1, stats.weak_decrements);
+}
+
+TEST(instrumentation_testing, object_disposed_while_weak_remains) {
+  struct sprocket {};
+  weak_ptr<sprocket> w;
+  {
+    shared_ptr<sprocket> p = make_shared<sprocket>();
+    w = p;
+    EXPECT_EQ(1, stats_of<sprocket>().live);
+  }
+  EXPECT_EQ(0, stats_of<sprocket>().live);
+  EXPECT_EQ(0, stats_of<sprocket>().bytes);
+}
+
+TEST(instrumentation_testing, arrays) {
+  struct cell {
+    int value;
+  };
+  shared_ptr<cell[]> p = make_shared<cell[]>(16);
+  auto stats = stats_of<cell[]>();
+  EXPECT_EQ(1, stats.live);
+  EXPECT_GE(stats.bytes, 16 * sizeof(cell));
+  EXPECT_EQ(0, stats_of<cell>().live);
+}
+
+TEST(instrumentation_testing, local_policy) {
+  struct local_widget {};
+  shared_ptr<local_widget, local_refcount> p =
+      make_local_shared<local_widget>();
+  EXPECT_EQ(1, stats_of<local_widget>().live);
+  p.reset();
+  EXPECT_EQ(0, stats_of<local_widget>().live);
+}
+
+TEST(instrumentation_testing, snapshot_lists_types) {
+  struct listed {};
+  shared_ptr<listed> p = make_shared<listed>();
+
+  auto all = shared_ptr_instrumentation::snapshot();
+  auto it = std::find_if(all.begin(), all.end(), [](auto const& stats) {
+    return stats.name == typeid(listed).name();
+  });
+  ASSERT_NE(all.end(), it);
+  EXPECT_EQ(1, it->live);
+}
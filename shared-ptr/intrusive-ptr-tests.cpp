@@ -0,0 +1,122 @@
+#include "intrusive-ptr.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+
+namespace {
+struct node : ref_counted<node> {
+  explicit node(int value, bool* destroyed = nullptr)
+      : value(value), destroyed(destroyed) {}
+
+  ~node() {
+    if (destroyed) {
+      *destroyed = true;
+    }
+  }
+
+  test_object value;
+  bool* destroyed;
+};
+
+struct local_node : ref_counted<local_node, local_refcount> {
+  int value = 42;
+};
+
+struct derived_node : node {
+  using node::node;
+};
+} // namespace
+
+static_assert(sizeof(intrusive_ptr<node>) == sizeof(node*));
+
+TEST(intrusive_ptr_testing, default_ctor) {
+  intrusive_ptr<node> p;
+  EXPECT_EQ(nullptr, p.get());
+  EXPECT_FALSE(static_cast<bool>(p));
+}
+
+TEST(intrusive_ptr_testing, make_intrusive) {
+  test_object::no_new_instances_guard g;
+  bool destroyed = false;
+  {
+    intrusive_ptr<node> p = make_intrusive<node>(42, &destroyed);
+    EXPECT_EQ(42, p->value);
+    EXPECT_EQ(1, p->use_count());
+  }
+  EXPECT_TRUE(destroyed);
+}
+
+TEST(intrusive_ptr_testing, copy_and_move) {
+  test_object::no_new_instances_guard g;
+  intrusive_ptr<node> p = make_intrusive<node>(42);
+  intrusive_ptr<node> q = p;
+  EXPECT_EQ(2, p->use_count());
+  EXPECT_TRUE(p == q);
+
+  intrusive_ptr<node> r = std::move(q);
+  EXPECT_FALSE(static_cast<bool>(q));
+  EXPECT_EQ(2, p->use_count());
+
+  r = p;
+  EXPECT_EQ(2, p->use_count());
+  r.reset();
+  EXPECT_EQ(1, p->use_count());
+}
+
+TEST(intrusive_ptr_testing, raw_pointer_round_trip) {
+  test_object::no_new_instances_guard g;
+  intrusive_ptr<node> p = make_intrusive<node>(42);
+  node* raw = intrusive_ptr<node>(p).detach();
+  EXPECT_EQ(2, raw->use_count());
+  intrusive_ptr<node> q(raw, false);
+  EXPECT_EQ(2, q->use_count());
+  intrusive_ptr<node> r(raw);
+  EXPECT_EQ(3, r->use_count());
+}
+
+TEST(intrusive_ptr_testing, copied_object_has_own_count) {
+  test_object::no_new_instances_guard g;
+  intrusive_ptr<node> p = make_intrusive<node>(42);
+  intrusive_ptr<node> q = p;
+  intrusive_ptr<node> copy = make_intrusive<node>(*p);
+  EXPECT_EQ(1, copy->use_count());
+  EXPECT_EQ(42, copy->value);
+}
+
+TEST(intrusive_ptr_testing, conversions_inheritance) {
+  bool destroyed = false;
+  {
+    intrusive_ptr<derived_node> d = make_intrusive<derived_node>(1, &destroyed);
+    intrusive_ptr<node> b = d;
+    EXPECT_EQ(d.get(), b.get());
+    d.reset();
+    EXPECT_FALSE(destroyed);
+  }
+  EXPECT_TRUE(destroyed);
+}
+
+TEST(intrusive_ptr_testing, local_policy) {
+  intrusive_ptr<local_node> p = make_intrusive<local_node>();
+  intrusive_ptr<local_node> q = p;
+  EXPECT_EQ(2, q->use_count());
+  EXPECT_EQ(42, q->value);
+}
+
+TEST(intrusive_ptr_testing, to_shared) {
+  test_object::no_new_instances_guard g;
+  bool destroyed = false;
+  shared_ptr<node> s;
+  {
+    intrusive_ptr<node> p = make_intrusive<node>(42, &destroyed);
+    s = to_shared(p);
+    shared_ptr<node> t = s;
+    EXPECT_EQ(2, p->use_count());
+    EXPECT_EQ(2, s.use_count());
+    EXPECT_EQ(p.get(), s.get());
+  }
+  EXPECT_FALSE(destroyed);
+  EXPECT_EQ(1, s->use_count());
+  s.reset();
+  EXPECT_TRUE(destroyed);
+
+  EXPECT_FALSE(static_cast<bool>(to_shared(intrusive_ptr<node>())));
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "shared-ptr.h"
+
+// base for objects that carry their own reference count; the count is not
+// copied along with the object and the last release deletes it as T
+template <typename T, typename Policy = atomic_refcount>
+class ref_counted {
+  mutable shared_ptr_details::ref_counter<Policy> refs;
+
+protected:
+  ref_counted() noexcept = default;
+
+  ref_counted(ref_counted const&) noexcept {}
+
+  ref_counted& operator=(ref_counted const&) noexcept {
+    return *this;
+  }
+
+  ~ref_counted() = default;
+
+public:
+  void add_ref() const noexcept {
+    refs.increment();
+  }
+
+  void release() const noexcept {
+    if (refs.decrement()) {
+      delete static_cast<T const*>(this);
+    }
+  }
+
+  size_t use_count() const noexcept {
+    return refs.get();
+  }
+};
+
+// a single-pointer handle for any T with add_ref() and release()
+template <typename T>
+class intrusive_ptr {
+  T* ptr{nullptr};
+
+  template <typename U>
+  friend class intrusive_ptr;
+
+public:
+  intrusive_ptr() noexcept = default;
+  intrusive_ptr(std::nullptr_t) noexcept {}
+
+  // add_ref = false adopts a reference the caller already holds
+  explicit intrusive_ptr(T* ptr_, bool add_ref = true) noexcept : ptr(ptr_) {
+    if (ptr && add_ref) {
+      ptr->add_ref();
+    }
+  }
+
+  intrusive_ptr(intrusive_ptr const& other) noexcept
+      : intrusive_ptr(other.ptr) {}
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  intrusive_ptr(intrusive_ptr<U> const& other) noexcept
+      : intrusive_ptr(other.ptr) {}
+
+  intrusive_ptr(intrusive_ptr&& other) noexcept : ptr(other.ptr) {
+    other.ptr = nullptr;
+  }
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  intrusive_ptr(intrusive_ptr<U>&& other) noexcept : ptr(other.ptr) {
+    other.ptr = nullptr;
+  }
+
+  intrusive_ptr& operator=(intrusive_ptr const& other) noexcept {
+    intrusive_ptr(other).swap(*this);
+    return *this;
+  }
+
+  intrusive_ptr& operator=(intrusive_ptr&& other) noexcept {
+    intrusive_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  ~intrusive_ptr() {
+    if (ptr) {
+      ptr->release();
+    }
+  }
+
+  T* get() const noexcept {
+    return ptr;
+  }
+
+  T& operator*() const noexcept {
+    return *ptr;
+  }
+
+  T* operator->() const noexcept {
+    return ptr;
+  }
+
+  explicit operator bool() const noexcept {
+    return ptr != nullptr;
+  }
+
+  void reset() noexcept {
+    intrusive_ptr().swap(*this);
+  }
+
+  void reset(T* new_ptr) noexcept {
+    intrusive_ptr(new_ptr).swap(*this);
+  }
+
+  // gives up ownership without releasing the reference
+  T* detach() noexcept {
+    T* result = ptr;
+    ptr = nullptr;
+    return result;
+  }
+
+  void swap(intrusive_ptr& other) noexcept {
+    std::swap(ptr, other.ptr);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(intrusive_ptr<T> const& a, intrusive_ptr<U> const& b) {
+  return a.get() == b.get();
+}
+
+template <typename T, typename U>
+bool operator!=(intrusive_ptr<T> const& a, intrusive_ptr<U> const& b) {
+  return a.get() != b.get();
+}
+
+template <typename T, typename... Args>
+intrusive_ptr<T> make_intrusive(Args&&... args) {
+  return intrusive_ptr<T>(new T(std::forward<Args>(args)...));
+}
+
+namespace shared_ptr_details {
+struct intrusive_releaser {
+  template <typename T>
+  void operator()(T* ptr) const noexcept {
+    ptr->release();
+  }
+};
+} // namespace shared_ptr_details
+
+// a shared_ptr that keeps one intrusive reference for as long as any of its
+// copies live; this allocates a control block, so convert at API boundaries
+// rather than on hot paths
+template <typename Policy = atomic_refcount, typename T>
+shared_ptr<T, Policy> to_shared(intrusive_ptr<T> const& p) {
+  if (!p) {
+    return shared_ptr<T, Policy>();
+  }
+  // if the block can't be allocated the deleter drops this reference
+  p->add_ref();
+  return shared_ptr<T, Policy>(p.get(),
+                               shared_ptr_details::intrusive_releaser());
+}
@@ -1,39 +1,259 @@
 #include "shared-ptr.h"
+#include <new>
+
 namespace shared_ptr_details {
-control_block::control_block() noexcept = default;
+template <typename Policy>
+control_block<Policy>::control_block(manager_t manager, bool tracked) noexcept
+    : counts(WEAK_ONE | (tracked ? TRACKED : 0)), manager(manager) {}
+
+template <typename Policy>
+void control_block<Policy>::record([[maybe_unused]] event e) noexcept {
+#ifdef SHARED_PTR_INSTRUMENTATION
+  if (!counters) {
+    return;
+  }
+  switch (e) {
+  case event::strong_increment:
+    counters->strong_increments.fetch_add(1, std::memory_order_relaxed);
+    break;
+  case event::strong_decrement:
+    counters->strong_decrements.fetch_add(1, std::memory_order_relaxed);
+    break;
+  case event::weak_increment:
+    counters->weak_increments.fetch_add(1, std::memory_order_relaxed);
+    break;
+  case event::weak_decrement:
+    counters->weak_decrements.fetch_add(1, std::memory_order_relaxed);
+    break;
+  case event::dispose:
+    counters->on_dispose(counted_bytes);
+    break;
+  }
+#endif
+}
+
+template <typename Policy>
+void control_block<Policy>::inc_strong() noexcept {
+  record(event::strong_increment);
+  counts.add(STRONG_ONE);
+}
 
-void control_block::inc_strong() noexcept {
-  strong_cnt += 1;
-  weak_cnt += 1;
+template <typename Policy>
+bool control_block<Policy>::inc_strong_if_nonzero() noexcept {
+  uint64_t word = counts.get();
+  do {
+    // one comparison rejects both no strong references and a dying object
+    if (static_cast<int64_t>(word) < static_cast<int64_t>(STRONG_ONE)) {
+      return false;
+    }
+  } while (!counts.compare_exchange(word, word + STRONG_ONE));
+  record(event::strong_increment);
+  return true;
 }
 
-void control_block::inc_weak() noexcept {
-  weak_cnt += 1;
+template <typename Policy>
+void control_block<Policy>::inc_weak() noexcept {
+  record(event::weak_increment);
+  counts.add(WEAK_ONE);
 }
 
-void control_block::dec_weak() noexcept {
-  weak_cnt -= 1;
-  if (weak_cnt == 0) {
-    delete this;
+template <typename Policy>
+void control_block<Policy>::dec_weak() noexcept {
+  record(event::weak_decrement);
+  if ((counts.sub(WEAK_ONE) & WEAK_MASK) == WEAK_ONE) {
+    manager(this, operation::destroy);
   }
 }
 
-void control_block::dec_strong() noexcept {
-  strong_cnt -= 1;
-  if (strong_cnt == 0) {
-    delete_data();
+// exactly one strong and the strong owners' weak reference means this is
+// the last owner and no weak_ptr exists; nobody else can reach the block,
+// so the object and the block go away without touching the counts.
+// Tracked blocks never match and always take the second path.
+//
+// A tracked block is queued as a possible root before the reference goes:
+// once it is gone another thread may drop the last one and free the block,
+// and the weak reference the queue takes is what keeps it around.
+template <typename Policy>
+void control_block<Policy>::dec_strong() noexcept {
+  record(event::strong_decrement);
+  uint64_t word = counts.get();
+  if (word == STRONG_ONE + WEAK_ONE) {
+    record(event::dispose);
+    manager(this, operation::dispose_and_destroy);
+    return;
+  }
+  if (word & TRACKED) {
+    manager(this, operation::possible_root);
+  }
+  uint64_t old = counts.sub(STRONG_ONE);
+  if (old >> 32 == 1) {
+    record(event::dispose);
+    manager(this, operation::dispose);
+    dec_weak();
+  }
+}
+
+template <typename Policy>
+control_block<Policy>::~control_block() = default;
+
+template <typename Policy>
+size_t control_block<Policy>::get_strong_cnt() const noexcept {
+  uint64_t word = counts.get();
+  return word & DYING ? 0 : word >> 32;
+}
+
+template <typename Policy>
+void control_block<Policy>::begin_collect() noexcept {
+  counts.add(DYING);
+}
+
+template <typename Policy>
+void control_block<Policy>::end_collect() noexcept {
+  record(event::dispose);
+  uint64_t word = counts.get();
+  while (!counts.compare_exchange(word, word & ~STRONG_MASK)) {
   }
   dec_weak();
 }
 
-control_block::~control_block() = default;
+// weak_ptrs only, without the one held by the strong owners
+template <typename Policy>
+size_t control_block<Policy>::get_weak_cnt() const noexcept {
+  uint64_t word = counts.get();
+  return (word & WEAK_MASK) - (word >> 32 != 0 ? 1 : 0);
+}
 
-size_t control_block::get_strong_cnt() const noexcept {
-  return strong_cnt;
+template <typename Policy>
+bool control_block<Policy>::tracked() const noexcept {
+  return counts.get() & TRACKED;
 }
 
-size_t control_block::get_weak_cnt() const noexcept {
-  return weak_cnt;
+namespace {
+struct free_node {
+  free_node* next;
+};
+
+struct pool_cache {
+  static constexpr size_t CLASSES =
+      block_pool::MAX_POOLED_SIZE / block_pool::SIZE_CLASS;
+
+  free_node* heads[CLASSES]{};
+  size_t sizes[CLASSES]{};
+
+  ~pool_cache() {
+    for (size_t i = 0; i < CLASSES; ++i) {
+      while (heads[i]) {
+        free_node* next = heads[i]->next;
+        ::operator delete(heads[i]);
+        heads[i] = next;
+      }
+    }
+    destroyed = true;
+  }
+
+  // blocks released by other thread_local destructors after this one
+  // has run go straight to the heap
+  static thread_local bool destroyed;
+};
+
+thread_local bool pool_cache::destroyed = false;
+thread_local pool_cache cache;
+
+bool is_pooled(size_t size, size_t alignment) noexcept {
+  return size != 0 && size <= block_pool::MAX_POOLED_SIZE &&
+         alignment <= alignof(std::max_align_t);
 }
 
-}
\ No newline at end of file
+size_t size_class(size_t size) noexcept {
+  return (size - 1) / block_pool::SIZE_CLASS;
+}
+} // namespace
+
+void* block_pool::allocate(size_t size, size_t alignment) {
+  if (!is_pooled(size, alignment)) {
+    return ::operator new(size, std::align_val_t(alignment));
+  }
+  size_t cls = size_class(size);
+  if (!pool_cache::destroyed && cache.heads[cls]) {
+    free_node* node = cache.heads[cls];
+    cache.heads[cls] = node->next;
+    cache.sizes[cls] -= 1;
+    return node;
+  }
+  return ::operator new((cls + 1) * SIZE_CLASS);
+}
+
+void block_pool::deallocate(void* p, size_t size, size_t alignment) noexcept {
+  if (!is_pooled(size, alignment)) {
+    ::operator delete(p, std::align_val_t(alignment));
+    return;
+  }
+  size_t cls = size_class(size);
+  if (pool_cache::destroyed || cache.sizes[cls] == MAX_CACHED_PER_CLASS) {
+    ::operator delete(p);
+    return;
+  }
+  cache.heads[cls] = new (p) free_node{cache.heads[cls]};
+  cache.sizes[cls] += 1;
+}
+
+#ifdef SHARED_PTR_INSTRUMENTATION
+namespace {
+std::atomic<type_counters*> registered{nullptr};
+} // namespace
+
+type_counters::type_counters(char const* name) noexcept : name(name) {
+  type_counters* head = registered.load(std::memory_order_relaxed);
+  do {
+    next = head;
+  } while (!registered.compare_exchange_weak(head, this,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+}
+
+void type_counters::on_create(size_t size) noexcept {
+  size_t now = live.fetch_add(1, std::memory_order_relaxed) + 1;
+  bytes.fetch_add(size, std::memory_order_relaxed);
+  size_t highest = peak.load(std::memory_order_relaxed);
+  while (now > highest &&
+         !peak.compare_exchange_weak(highest, now, std::memory_order_relaxed)) {
+  }
+}
+
+void type_counters::on_dispose(size_t size) noexcept {
+  live.fetch_sub(1, std::memory_order_relaxed);
+  bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+#endif
+
+template class control_block<atomic_refcount>;
+template class control_block<local_refcount>;
+}
+
+#ifdef SHARED_PTR_INSTRUMENTATION
+namespace shared_ptr_instrumentation {
+type_stats stats_of(shared_ptr_details::type_counters const& counters) {
+  auto read = [](std::atomic<size_t> const& value) {
+    return value.load(std::memory_order_relaxed);
+  };
+  return {counters.name,
+          read(counters.live),
+          read(counters.peak),
+          read(counters.bytes),
+          read(counters.strong_increments),
+          read(counters.strong_decrements),
+          read(counters.weak_increments),
+          read(counters.weak_decrements)};
+}
+
+std::vector<type_stats> snapshot() {
+  std::vector<type_stats> result;
+  for (auto* counters =
+           shared_ptr_details::registered.load(std::memory_order_acquire);
+       counters; counters = counters->next) {
+    result.push_back(stats_of(*counters));
+  }
+  return result;
+}
+} // namespace shared_ptr_instrumentation
+#endif
@@ -1,75 +1,629 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <new>
+
+#ifdef SHARED_PTR_INSTRUMENTATION
+#include <string>
+#include <typeinfo>
+#include <vector>
+#endif
+
+// reference counting policies: with atomic_refcount (the default) copies of
+// one shared_ptr may be created and destroyed from different threads, the
+// pointee itself is not synchronized; local_refcount uses plain counters for
+// objects that never leave their thread
+struct atomic_refcount {};
+struct local_refcount {};
+
+template <typename T, typename Policy = atomic_refcount>
+class shared_ptr;
+
+template <typename T, typename Policy = atomic_refcount>
+class weak_ptr;
+
+template <typename T, typename Policy = atomic_refcount>
+class enable_shared_from_this;
 
 template <typename T>
-class shared_ptr;
+using local_shared_ptr = shared_ptr<T, local_refcount>;
+
+template <typename T>
+using local_weak_ptr = weak_ptr<T, local_refcount>;
 
-template <typename T, typename... Args>
-shared_ptr<T> make_shared(Args&&... args);
 namespace shared_ptr_details {
 
-class control_block {
-  size_t strong_cnt{0};
-  size_t weak_cnt{0};
+template <typename Policy>
+class ref_counter;
 
-  template <typename T>
-  friend class shared_ptr;
+// a new reference is always made from an existing one, so increments need no
+// ordering; the decrement that drops a count to zero must see every write
+// made through the other references before it destroys anything
+template <>
+class ref_counter<atomic_refcount> {
+  std::atomic<size_t> value{0};
+
+public:
+  void increment() noexcept {
+    value.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // true if the count dropped to zero
+  bool decrement() noexcept {
+    return value.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  size_t get() const noexcept {
+    return value.load(std::memory_order_acquire);
+  }
+};
+
+template <>
+class ref_counter<local_refcount> {
+  size_t value{0};
+
+public:
+  void increment() noexcept {
+    value += 1;
+  }
+
+  bool decrement() noexcept {
+    return --value == 0;
+  }
+
+  size_t get() const noexcept {
+    return value;
+  }
+};
+
+// both counts of a control block in one 64-bit word, so every change is a
+// single read-modify-write; orderings follow ref_counter
+template <typename Policy>
+class count_word;
+
+template <>
+class count_word<atomic_refcount> {
+  std::atomic<uint64_t> value;
+
+public:
+  explicit count_word(uint64_t value) noexcept : value(value) {}
 
+  void add(uint64_t delta) noexcept {
+    value.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  // returns the value before the subtraction
+  uint64_t sub(uint64_t delta) noexcept {
+    return value.fetch_sub(delta, std::memory_order_acq_rel);
+  }
+
+  uint64_t get() const noexcept {
+    return value.load(std::memory_order_acquire);
+  }
+
+  // on failure expected receives the current value
+  bool compare_exchange(uint64_t& expected, uint64_t desired) noexcept {
+    return value.compare_exchange_weak(expected, desired,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire);
+  }
+};
+
+template <>
+class count_word<local_refcount> {
+  uint64_t value;
+
+public:
+  explicit count_word(uint64_t value) noexcept : value(value) {}
+
+  void add(uint64_t delta) noexcept {
+    value += delta;
+  }
+
+  uint64_t sub(uint64_t delta) noexcept {
+    uint64_t old = value;
+    value -= delta;
+    return old;
+  }
+
+  uint64_t get() const noexcept {
+    return value;
+  }
+
+  bool compare_exchange(uint64_t& expected, uint64_t desired) noexcept {
+    if (value != expected) {
+      expected = value;
+      return false;
+    }
+    value = desired;
+    return true;
+  }
+};
+
+#ifdef SHARED_PTR_INSTRUMENTATION
+// live objects and reference-count traffic of one type, shared by every
+// block holding that type; created on first use and never destroyed
+struct type_counters {
+  explicit type_counters(char const* name) noexcept;
+
+  void on_create(size_t size) noexcept;
+  void on_dispose(size_t size) noexcept;
+
+  char const* const name;
+  std::atomic<size_t> live{0};
+  std::atomic<size_t> peak{0};
+  std::atomic<size_t> bytes{0};
+  std::atomic<size_t> strong_increments{0};
+  std::atomic<size_t> strong_decrements{0};
+  std::atomic<size_t> weak_increments{0};
+  std::atomic<size_t> weak_decrements{0};
+  type_counters* next{nullptr};
+};
+
+template <typename T>
+type_counters& counters_of() noexcept {
+  static type_counters counters(typeid(T).name());
+  return counters;
+}
+#endif
+
+// blocks are not polymorphic: the concrete block passes a manager function
+// that destroys the object, frees the block or does both in one call.
+//
+// The strong count sits in the upper half of the word and the weak count in
+// the lower one. All strong references together hold a single weak
+// reference, so a copy or a release that doesn't end the object's life
+// touches the word once. The top bit of the weak half marks blocks a cycle
+// collector tracks; only those get a possible_root call, made before a
+// release that isn't known to be the last one. The top bit of the strong
+// half marks an object a cycle collector is destroying.
+template <typename Policy>
+class control_block {
+public:
+  enum class operation { dispose, destroy, dispose_and_destroy, possible_root };
+  using manager_t = void (*)(control_block*, operation) noexcept;
+
+private:
+  static constexpr uint64_t WEAK_ONE = 1;
+  static constexpr uint64_t STRONG_ONE = uint64_t(1) << 32;
+  static constexpr uint64_t TRACKED = STRONG_ONE >> 1;
+  static constexpr uint64_t WEAK_MASK = TRACKED - 1;
+  static constexpr uint64_t STRONG_MASK = ~(STRONG_ONE - 1);
+  static constexpr uint64_t DYING = uint64_t(1) << 63;
+
+  // the weak reference of the strong owners is there from the start; the
+  // block is created for its first strong reference
+  count_word<Policy> counts;
+  manager_t manager;
+
+#ifdef SHARED_PTR_INSTRUMENTATION
+  type_counters* counters{nullptr};
+  size_t counted_bytes{0};
+#endif
+
+  enum class event {
+    strong_increment,
+    strong_decrement,
+    weak_increment,
+    weak_decrement,
+    dispose
+  };
+
+  // does nothing unless SHARED_PTR_INSTRUMENTATION is defined
+  void record(event e) noexcept;
+
+protected:
+  explicit control_block(manager_t manager, bool tracked = false) noexcept;
+  ~control_block();
+
+  // counts a new live object of type T, holding size bytes together with
+  // its block; blocks call it once the object is constructed
   template <typename T>
-  friend class weak_ptr;
+  void instrument([[maybe_unused]] size_t size) noexcept {
+#ifdef SHARED_PTR_INSTRUMENTATION
+    counters = &counters_of<T>();
+    counted_bytes = size;
+    counters->on_create(size);
+#endif
+  }
+
+  // for the cycle collector: from begin_collect() on, lock() fails and the
+  // strong count reads 0, while the references the dead objects hold on
+  // each other are still released; end_collect() drops the strong half
+  // whatever is left in it, with the weak reference of the strong owners
+  void begin_collect() noexcept;
+  void end_collect() noexcept;
 
 public:
-  control_block() noexcept;
   void inc_strong() noexcept;
+  // for weak_ptr::lock: takes a strong reference unless the object is
+  // already gone, as one atomic step
+  bool inc_strong_if_nonzero() noexcept;
   void inc_weak() noexcept;
   void dec_strong() noexcept;
   void dec_weak() noexcept;
   size_t get_strong_cnt() const noexcept;
   size_t get_weak_cnt() const noexcept;
-  virtual void delete_data() = 0;
-  virtual ~control_block();
+  bool tracked() const noexcept;
+};
+
+// holds the allocator as a base, so a stateless one takes no space; being a
+// distinct type it can't clash with a deleter base
+template <typename Alloc>
+struct allocator_holder : Alloc {
+  explicit allocator_holder(Alloc const& alloc) : Alloc(alloc) {}
+
+  Alloc const& get_allocator() const noexcept {
+    return *this;
+  }
 };
 
-template <typename T, class D>
-class ptr_block : public control_block, public D {
+template <typename Block, typename Alloc>
+using block_alloc_traits =
+    typename std::allocator_traits<Alloc>::template rebind_traits<Block>;
+
+// blocks live in memory from their own allocator; if the constructor throws
+// the memory is given back before the exception leaves
+template <typename Block, typename Alloc, typename... Args>
+Block* create_block(Alloc const& alloc, Args&&... args) {
+  using traits = block_alloc_traits<Block, Alloc>;
+  typename traits::allocator_type block_alloc(alloc);
+  Block* block = traits::allocate(block_alloc, 1);
+  try {
+    new (block) Block(alloc, std::forward<Args>(args)...);
+  } catch (...) {
+    traits::deallocate(block_alloc, block, 1);
+    throw;
+  }
+  return block;
+}
+
+template <typename Block>
+void destroy_block(Block* block) noexcept {
+  using traits = block_alloc_traits<Block, typename Block::allocator_type>;
+  typename traits::allocator_type block_alloc(block->get_allocator());
+  block->~Block();
+  traits::deallocate(block_alloc, block, 1);
+}
+
+// asks for default- rather than value-initialization of the object
+struct default_init_t {};
+
+template <typename T, class D, typename Alloc, typename Policy>
+class ptr_block : public control_block<Policy>,
+                  public D,
+                  public allocator_holder<Alloc> {
+  using operation = typename control_block<Policy>::operation;
+
   T* ptr;
 
-public:
-  ptr_block(T* ptr_, D d) : control_block(), D(std::move(d)), ptr(ptr_) {
-    inc_strong();
+  static void manage(control_block<Policy>* block, operation op) noexcept {
+    auto* self = static_cast<ptr_block*>(block);
+    if (op != operation::destroy) {
+      static_cast<D&>(*self)(self->ptr);
+    }
+    if (op != operation::dispose) {
+      destroy_block(self);
+    }
   }
 
-  void delete_data() override {
-    static_cast<D&> (*this)(ptr);
+public:
+  using allocator_type = Alloc;
+
+  ptr_block(Alloc const& alloc, T* ptr_, D d)
+      : control_block<Policy>(&manage), D(std::move(d)),
+        allocator_holder<Alloc>(alloc), ptr(ptr_) {
+    // kept out of ordinary builds, where T may be incomplete here; it comes
+    // first so the first strong reference is counted too
+#ifdef SHARED_PTR_INSTRUMENTATION
+    this->template instrument<T>(sizeof(ptr_block) + sizeof(T));
+#endif
+    this->inc_strong();
   }
 };
 
-template <typename T>
-class obj_block : public control_block {
+template <typename T, typename Alloc, typename Policy>
+class obj_block : public control_block<Policy>,
+                  public allocator_holder<Alloc> {
+  using operation = typename control_block<Policy>::operation;
+
   std::aligned_storage_t<sizeof(T), alignof(T)> obj;
 
-  template <typename U, typename... Args>
-  friend ::shared_ptr<U> (::make_shared(Args&&... args));
+  static void manage(control_block<Policy>* block, operation op) noexcept {
+    auto* self = static_cast<obj_block*>(block);
+    if (op != operation::destroy) {
+      self->get()->~T();
+    }
+    if (op != operation::dispose) {
+      destroy_block(self);
+    }
+  }
 
 public:
+  using allocator_type = Alloc;
+
   template <typename... Args>
-  obj_block(Args&&... args) : control_block() {
+  obj_block(Alloc const& alloc, Args&&... args)
+      : control_block<Policy>(&manage), allocator_holder<Alloc>(alloc) {
     new (&obj) T(std::forward<Args>(args)...);
+    this->template instrument<T>(sizeof(obj_block));
   }
 
-  void delete_data() override {
-    reinterpret_cast<T*>(&obj)->~T();
+  obj_block(Alloc const& alloc, default_init_t)
+      : control_block<Policy>(&manage), allocator_holder<Alloc>(alloc) {
+    new (&obj) T;
+    this->template instrument<T>(sizeof(obj_block));
+  }
+
+  T* get() noexcept {
+    return reinterpret_cast<T*>(&obj);
   }
 };
+
+// the block and n elements in one allocation, elements following the block;
+// the memory is counted in units aligned for both
+template <typename T, typename Alloc, typename Policy>
+class array_block : public control_block<Policy>,
+                    public allocator_holder<Alloc> {
+  static_assert(!std::is_array_v<T>, "arrays of arrays are not supported");
+
+  using operation = typename control_block<Policy>::operation;
+
+  static constexpr size_t UNIT_ALIGN =
+      std::max({alignof(T), alignof(control_block<Policy>), alignof(Alloc),
+                alignof(size_t)});
+  using unit = std::aligned_storage_t<UNIT_ALIGN, UNIT_ALIGN>;
+  using unit_traits = block_alloc_traits<unit, Alloc>;
+
+  size_t size;
+
+  static size_t elements_offset() noexcept {
+    return (sizeof(array_block) + alignof(T) - 1) / alignof(T) * alignof(T);
+  }
+
+  static size_t units(size_t n) noexcept {
+    return (elements_offset() + n * sizeof(T) + sizeof(unit) - 1) /
+           sizeof(unit);
+  }
+
+  static void destroy_elements(T* first, size_t n) noexcept {
+    while (n != 0) {
+      first[--n].~T();
+    }
+  }
+
+  static void manage(control_block<Policy>* block, operation op) noexcept {
+    auto* self = static_cast<array_block*>(block);
+    if (op != operation::destroy) {
+      destroy_elements(self->get(), self->size);
+    }
+    if (op != operation::dispose) {
+      typename unit_traits::allocator_type alloc(self->get_allocator());
+      size_t n = units(self->size);
+      self->~array_block();
+      unit_traits::deallocate(alloc, reinterpret_cast<unit*>(self), n);
+    }
+  }
+
+  array_block(Alloc const& alloc, size_t size)
+      : control_block<Policy>(&manage), allocator_holder<Alloc>(alloc),
+        size(size) {}
+
+public:
+  T* get() noexcept {
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(this) +
+                                elements_offset());
+  }
+
+  // value-initializes the elements, or default-initializes them when
+  // default_init is set; if an element throws, the ones already built are
+  // destroyed and the memory is freed
+  static array_block* create(Alloc const& alloc, size_t n, bool default_init) {
+    if (n > (std::numeric_limits<size_t>::max() - elements_offset() -
+             (sizeof(unit) - 1)) /
+                sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    typename unit_traits::allocator_type unit_alloc(alloc);
+    unit* memory = unit_traits::allocate(unit_alloc, units(n));
+    auto* block = new (memory) array_block(alloc, n);
+    T* first = block->get();
+    size_t built = 0;
+    try {
+      for (; built != n; ++built) {
+        if (default_init) {
+          new (first + built) T;
+        } else {
+          new (first + built) T();
+        }
+      }
+    } catch (...) {
+      destroy_elements(first, built);
+      block->~array_block();
+      unit_traits::deallocate(unit_alloc, memory, units(n));
+      throw;
+    }
+    block->template instrument<T[]>(units(n) * sizeof(unit));
+    return block;
+  }
+};
+
+// whether a raw Y* can be owned by shared_ptr<T>. For T[] the pointer must
+// be convertible as a pointer to an array of the same kind, so a Derived[]
+// never becomes a Base[]
+template <typename Y, typename T>
+struct is_ownable : std::is_convertible<Y*, T*> {};
+
+template <typename Y, typename U>
+struct is_ownable<Y, U[]> : std::is_convertible<Y (*)[], U (*)[]> {};
+
+template <typename Y, typename U, size_t N>
+struct is_ownable<Y, U[N]> : std::is_convertible<Y (*)[N], U (*)[N]> {};
+
+template <typename Y, typename T>
+constexpr bool is_ownable_v = is_ownable<Y, T>::value;
+
+// whether shared_ptr<Y> and weak_ptr<Y> convert to their T versions: Y*
+// converts to T*, or Y is U[N] and T is cv U[]
+template <typename Y, typename T>
+struct is_compatible : std::is_convertible<Y*, T*> {};
+
+template <typename Y, size_t N, typename U>
+struct is_compatible<Y[N], U[]> : std::is_convertible<Y (*)[], U (*)[]> {};
+
+template <typename Y, typename T>
+constexpr bool is_compatible_v = is_compatible<Y, T>::value;
+
+// delete[] for the raw-pointer constructors of shared_ptr<T[]> and
+// shared_ptr<T[N]>
+template <typename T, typename U>
+using default_deleter =
+    std::conditional_t<std::is_array_v<T>,
+                       std::default_delete<std::remove_extent_t<T>[]>,
+                       std::default_delete<U>>;
+
+// thread-local free lists of recently released blocks, one per 16-byte size
+// class up to MAX_POOLED_SIZE; bigger or over-aligned requests and lists that
+// are already full go to the global heap. A block freed on another thread
+// simply joins that thread's list.
+struct block_pool {
+  static constexpr size_t SIZE_CLASS = 16;
+  static constexpr size_t MAX_POOLED_SIZE = 512;
+  static constexpr size_t MAX_CACHED_PER_CLASS = 1024;
+
+  static void* allocate(size_t size, size_t alignment);
+  static void deallocate(void* p, size_t size, size_t alignment) noexcept;
+};
+
+// builds pointers on top of an existing block, taking a new reference
+struct access {
+  template <typename T, typename Policy>
+  static shared_ptr<T, Policy> make_shared(control_block<Policy>* block,
+                                           std::remove_extent_t<T>* ptr) {
+    return shared_ptr<T, Policy>(block, ptr);
+  }
+
+  // the block p shares, null if p owns nothing
+  template <typename T, typename Policy>
+  static control_block<Policy>* block_of(
+      shared_ptr<T, Policy> const& p) noexcept {
+    return p.block;
+  }
+
+  // both point to the same object and share ownership of it
+  template <typename T, typename Policy>
+  static bool equivalent(shared_ptr<T, Policy> const& a,
+                         shared_ptr<T, Policy> const& b) noexcept {
+    return a.ptr == b.ptr && a.block == b.block;
+  }
+
+  // points the object's weak_this at a block that has just taken ownership
+  // of it, unless it is already owned elsewhere
+  template <typename X, typename Policy, typename U>
+  static void link_shared_from_this(enable_shared_from_this<X, Policy> const* base,
+                                    control_block<Policy>* block,
+                                    U* ptr) noexcept;
+
+  static void link_shared_from_this(...) noexcept {}
+};
+
+template <typename T, typename Policy, typename Alloc, typename... Args>
+shared_ptr<T, Policy> allocate_shared_with_policy(Alloc const& alloc,
+                                                  Args&&... args) {
+  auto* block = create_block<obj_block<T, Alloc, Policy>>(
+      alloc, std::forward<Args>(args)...);
+  access::link_shared_from_this(block->get(), block, block->get());
+  return access::make_shared<T>(block, block->get());
+}
+
+template <typename T, typename Policy, typename Alloc>
+shared_ptr<T, Policy> allocate_shared_array(Alloc const& alloc, size_t n,
+                                            bool default_init) {
+  using element = std::remove_extent_t<T>;
+  auto* block =
+      array_block<element, Alloc, Policy>::create(alloc, n, default_init);
+  return access::make_shared<T>(block, block->get());
 }
+} // namespace shared_ptr_details
+
+// a stateless allocator over shared_ptr_details::block_pool; pass it to
+// allocate_shared or the raw-pointer constructor to keep control blocks off
+// the global heap under heavy churn
 template <typename T>
+struct pool_allocator {
+  using value_type = T;
+
+  pool_allocator() noexcept = default;
+
+  template <typename U>
+  pool_allocator(pool_allocator<U> const&) noexcept {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(
+        shared_ptr_details::block_pool::allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    shared_ptr_details::block_pool::deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  template <typename U>
+  bool operator==(pool_allocator<U> const&) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(pool_allocator<U> const&) const noexcept {
+    return false;
+  }
+};
+
+#ifdef SHARED_PTR_INSTRUMENTATION
+// what the blocks of one type report: objects alive now and at most,
+// the bytes they hold together with their blocks, and reference counting
+// operations so far. Objects stop counting as alive once disposed.
+namespace shared_ptr_instrumentation {
+struct type_stats {
+  std::string name;
+  size_t live;
+  size_t peak;
+  size_t bytes;
+  size_t strong_increments;
+  size_t strong_decrements;
+  size_t weak_increments;
+  size_t weak_decrements;
+};
+
+// every type that has had a block so far
+std::vector<type_stats> snapshot();
+
+type_stats stats_of(shared_ptr_details::type_counters const& counters);
+
+template <typename T>
+type_stats stats_of() {
+  return stats_of(shared_ptr_details::counters_of<T>());
+}
+} // namespace shared_ptr_instrumentation
+#endif
+
+template <typename T, typename Policy>
 class shared_ptr {
-  T* ptr{nullptr};
-  shared_ptr_details::control_block* block{nullptr};
+public:
+  // for T[] and T[N] the pointer is to the first element
+  using element_type = std::remove_extent_t<T>;
+
+private:
+  using control_block = shared_ptr_details::control_block<Policy>;
+
+  element_type* ptr{nullptr};
+  control_block* block{nullptr};
 
-  shared_ptr(shared_ptr_details::control_block* block_, T* ptr_) {
+  shared_ptr(control_block* block_, element_type* ptr_) {
     try {
       ptr = ptr_;
       block = block_;
@@ -82,29 +636,49 @@ class shared_ptr {
     }
   }
 
-  template<typename U, typename... Args>
-  friend shared_ptr<U> make_shared(Args&& ... args);
+  friend struct shared_ptr_details::access;
 
-  template<typename U>
+  template <typename U, typename P>
   friend class shared_ptr;
 
-  template<typename U>
+  template <typename U, typename P>
   friend class weak_ptr;
 
 public:
   shared_ptr() noexcept = default;
   explicit shared_ptr(std::nullptr_t ptr_) noexcept : ptr(ptr_), block(nullptr) {}
 
-  template<typename U, class D = std::default_delete<U>,
-            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
-  shared_ptr(U* ptr_, D d = D()) : ptr(ptr_), block(new shared_ptr_details::ptr_block<U, D>(ptr_, std::move(d))) {}
+  template <typename U, class D = shared_ptr_details::default_deleter<T, U>,
+            typename = std::enable_if_t<
+                shared_ptr_details::is_ownable_v<U, T>>>
+  shared_ptr(U* ptr_, D d = D())
+      : shared_ptr(ptr_, std::move(d), std::allocator<U>()) {}
+
+  // the control block comes from alloc; if that fails the pointer is
+  // released with d before the exception propagates
+  template <typename U, class D, class Alloc,
+            typename = std::enable_if_t<
+                shared_ptr_details::is_ownable_v<U, T>>>
+  shared_ptr(U* ptr_, D d, Alloc const& alloc) : ptr(ptr_) {
+    try {
+      block = shared_ptr_details::create_block<
+          shared_ptr_details::ptr_block<U, D, Alloc, Policy>>(alloc, ptr_, d);
+    } catch (...) {
+      d(ptr_);
+      throw;
+    }
+    shared_ptr_details::access::link_shared_from_this(ptr_, block, ptr_);
+  }
 
   template <typename U,
-            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
-  shared_ptr(const shared_ptr<U>& other) noexcept: shared_ptr(other.block, other.ptr) {}
+            typename = std::enable_if_t<
+                shared_ptr_details::is_compatible_v<U, T>>>
+  shared_ptr(const shared_ptr<U, Policy>& other) noexcept
+      : shared_ptr(other.block, other.ptr) {}
 
   template <typename U>
-  shared_ptr(const shared_ptr<U> &other, T* ptr_) noexcept : shared_ptr(other.block, ptr_) {}
+  shared_ptr(const shared_ptr<U, Policy>& other, element_type* ptr_) noexcept
+      : shared_ptr(other.block, ptr_) {}
 
   shared_ptr(const shared_ptr &other) noexcept : shared_ptr(other.block, other.ptr) {}
 
@@ -126,7 +700,7 @@ public:
       return *this;
   }
 
-  T* get() const noexcept {
+  element_type* get() const noexcept {
       return ptr;
   }
 
@@ -134,14 +708,20 @@ public:
       return ptr != nullptr;
   }
 
-  T& operator*() const noexcept {
+  element_type& operator*() const noexcept {
     return *ptr;
   }
 
-  T* operator->() const noexcept {
+  element_type* operator->() const noexcept {
     return ptr;
   }
 
+  template <typename U = T,
+            typename = std::enable_if_t<std::is_array_v<U>>>
+  element_type& operator[](std::ptrdiff_t i) const noexcept {
+    return ptr[i];
+  }
+
   std::size_t use_count() const noexcept {
     if (block) return block->get_strong_cnt();
     return 0;
@@ -152,10 +732,10 @@ public:
   }
 
 
-  template <typename U, class D = std::default_delete<U>,
-      typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  template <typename U, class D = shared_ptr_details::default_deleter<T, U>,
+      typename = std::enable_if_t<shared_ptr_details::is_ownable_v<U, T>>>
   void reset(U* new_ptr, D d = D()) {
-      shared_ptr<T>(new_ptr, d).swap(*this);
+      shared_ptr(new_ptr, d).swap(*this);
   }
 
   void swap(shared_ptr &other) {
@@ -172,58 +752,71 @@ public:
   }
 };
 
-template <typename T, typename U>
-bool operator==(const shared_ptr<T> &a, const shared_ptr<U> &b) {
+template <typename T, typename U, typename Policy>
+bool operator==(const shared_ptr<T, Policy>& a,
+                const shared_ptr<U, Policy>& b) {
   return a.get() == b.get();
 }
 
-template <typename T, typename U>
-bool operator!=(const shared_ptr<T> &a, const shared_ptr<U> &b) {
+template <typename T, typename U, typename Policy>
+bool operator!=(const shared_ptr<T, Policy>& a,
+                const shared_ptr<U, Policy>& b) {
   return a.get() != b.get();
 }
 
-template <typename T>
-bool operator==(const shared_ptr<T> &a, std::nullptr_t b) {
+template <typename T, typename Policy>
+bool operator==(const shared_ptr<T, Policy>& a, std::nullptr_t b) {
   return a.get() == b;
 }
 
-template <typename T>
-bool operator!=(const shared_ptr<T> &a, std::nullptr_t b) {
+template <typename T, typename Policy>
+bool operator!=(const shared_ptr<T, Policy>& a, std::nullptr_t b) {
   return a.get() != b;
 }
 
-template <typename T>
-bool operator==(std::nullptr_t a, const shared_ptr<T> &b) {
+template <typename T, typename Policy>
+bool operator==(std::nullptr_t a, const shared_ptr<T, Policy>& b) {
   return a == b.get();
 }
 
-template <typename T>
-bool operator!=(std::nullptr_t a, const shared_ptr<T> &b) {
+template <typename T, typename Policy>
+bool operator!=(std::nullptr_t a, const shared_ptr<T, Policy>& b) {
   return a != b.get();
 }
 
-template <typename T>
+template <typename T, typename Policy>
 class weak_ptr {
-  T* ptr{nullptr};
-  shared_ptr_details::control_block* block{nullptr};
-  weak_ptr(T* ptr_, shared_ptr_details::control_block* block_) noexcept : ptr(ptr_), block(block_){
+public:
+  using element_type = std::remove_extent_t<T>;
+
+private:
+  using control_block = shared_ptr_details::control_block<Policy>;
+
+  element_type* ptr{nullptr};
+  control_block* block{nullptr};
+  weak_ptr(element_type* ptr_, control_block* block_) noexcept : ptr(ptr_), block(block_){
     if (block) {
       block->inc_weak();
     }
   }
+
+  friend struct shared_ptr_details::access;
 public:
   weak_ptr() noexcept = default;
 
-  template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
-  weak_ptr(const shared_ptr<U>& other) noexcept : weak_ptr(other.ptr, other.block) {}
+  template <typename U, typename P>
+  friend class weak_ptr;
+
+  template<typename U, typename = std::enable_if_t<shared_ptr_details::is_compatible_v<U, T>>>
+  weak_ptr(const shared_ptr<U, Policy>& other) noexcept : weak_ptr(other.ptr, other.block) {}
 
-  template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
-  weak_ptr(const weak_ptr<U>& other) noexcept : weak_ptr(other.ptr, other.block) {}
+  template<typename U, typename = std::enable_if_t<shared_ptr_details::is_compatible_v<U, T>>>
+  weak_ptr(const weak_ptr<U, Policy>& other) noexcept : weak_ptr(other.ptr, other.block) {}
 
-  weak_ptr(const shared_ptr<T> &other) noexcept : weak_ptr(other.ptr, other.block) {}
+  weak_ptr(const shared_ptr<T, Policy> &other) noexcept : weak_ptr(other.ptr, other.block) {}
   weak_ptr(const weak_ptr &other) noexcept : weak_ptr(other.ptr, other.block) {}
 
-  weak_ptr& operator=(const shared_ptr<T>& other) noexcept {
+  weak_ptr& operator=(const shared_ptr<T, Policy>& other) noexcept {
     weak_ptr(other).swap(*this);
     return *this;
   }
@@ -234,6 +827,18 @@ public:
     return *this;
   }
 
+  template<typename U, typename = std::enable_if_t<shared_ptr_details::is_compatible_v<U, T>>>
+  weak_ptr& operator=(const shared_ptr<U, Policy>& other) noexcept {
+    weak_ptr(other).swap(*this);
+    return *this;
+  }
+
+  template<typename U, typename = std::enable_if_t<shared_ptr_details::is_compatible_v<U, T>>>
+  weak_ptr& operator=(const weak_ptr<U, Policy>& other) noexcept {
+    weak_ptr(other).swap(*this);
+    return *this;
+  }
+
   weak_ptr& operator=(weak_ptr&& other) noexcept {
     if (&other == this) return *this;
     other.swap(*this);
@@ -241,11 +846,22 @@ public:
     return *this;
   }
 
-  shared_ptr<T> lock() const noexcept {
-      if (block && block->get_strong_cnt() == 0) {
-        return shared_ptr<T>();
-      }
-      return shared_ptr<T>(block, ptr);
+  shared_ptr<T, Policy> lock() const noexcept {
+    shared_ptr<T, Policy> result;
+    if (block && block->inc_strong_if_nonzero()) {
+      result.ptr = ptr;
+      result.block = block;
+    }
+    return result;
+  }
+
+  // a single load, without touching the counts
+  std::size_t use_count() const noexcept {
+    return block ? block->get_strong_cnt() : 0;
+  }
+
+  bool expired() const noexcept {
+    return use_count() == 0;
   }
 
   ~weak_ptr() {
@@ -263,7 +879,127 @@ public:
 };
 
 template <typename T, typename... Args>
-shared_ptr<T> make_shared(Args&&... args) {
-  auto* block = new shared_ptr_details::obj_block<T>(std::forward<Args>(args)...);
-  return shared_ptr<T>(block, reinterpret_cast<T*>(&block->obj));
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T>>
+make_shared(Args&&... args) {
+  return shared_ptr_details::allocate_shared_with_policy<T, atomic_refcount>(
+      std::allocator<T>(), std::forward<Args>(args)...);
+}
+
+// the control block and all n value-initialized elements share one
+// allocation
+template <typename T>
+std::enable_if_t<std::is_array_v<T> && std::extent_v<T> == 0, shared_ptr<T>>
+make_shared(size_t n) {
+  return shared_ptr_details::allocate_shared_array<T, atomic_refcount>(
+      std::allocator<std::remove_extent_t<T>>(), n, false);
+}
+
+template <typename T>
+std::enable_if_t<std::extent_v<T> != 0, shared_ptr<T>> make_shared() {
+  return shared_ptr_details::allocate_shared_array<T, atomic_refcount>(
+      std::allocator<std::remove_extent_t<T>>(), std::extent_v<T>, false);
+}
+
+// like make_shared, but the object or the elements are default-initialized,
+// so trivial types such as I/O buffers are left unfilled
+template <typename T>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T>>
+make_shared_for_overwrite() {
+  return shared_ptr_details::allocate_shared_with_policy<T, atomic_refcount>(
+      std::allocator<T>(), shared_ptr_details::default_init_t());
+}
+
+template <typename T>
+std::enable_if_t<std::is_array_v<T> && std::extent_v<T> == 0, shared_ptr<T>>
+make_shared_for_overwrite(size_t n) {
+  return shared_ptr_details::allocate_shared_array<T, atomic_refcount>(
+      std::allocator<std::remove_extent_t<T>>(), n, true);
+}
+
+template <typename T>
+std::enable_if_t<std::extent_v<T> != 0, shared_ptr<T>>
+make_shared_for_overwrite() {
+  return shared_ptr_details::allocate_shared_array<T, atomic_refcount>(
+      std::allocator<std::remove_extent_t<T>>(), std::extent_v<T>, true);
+}
+
+template <typename T, typename... Args>
+local_shared_ptr<T> make_local_shared(Args&&... args) {
+  return shared_ptr_details::allocate_shared_with_policy<T, local_refcount>(
+      std::allocator<T>(), std::forward<Args>(args)...);
+}
+
+// like make_shared, but the single allocation holding the block and the
+// object comes from alloc
+template <typename T, typename Alloc, typename... Args>
+shared_ptr<T> allocate_shared(Alloc const& alloc, Args&&... args) {
+  return shared_ptr_details::allocate_shared_with_policy<T, atomic_refcount>(
+      alloc, std::forward<Args>(args)...);
+}
+
+template <typename T, typename Alloc, typename... Args>
+local_shared_ptr<T> allocate_local_shared(Alloc const& alloc, Args&&... args) {
+  return shared_ptr_details::allocate_shared_with_policy<T, local_refcount>(
+      alloc, std::forward<Args>(args)...);
+}
+
+// lets an object owned by a shared_ptr hand out more owners of itself; the
+// weak reference is set when make_shared, allocate_shared or a raw-pointer
+// constructor takes ownership, and lives inside the object itself
+template <typename T, typename Policy>
+class enable_shared_from_this {
+  mutable weak_ptr<T, Policy> weak_this;
+
+  friend struct shared_ptr_details::access;
+
+protected:
+  enable_shared_from_this() noexcept = default;
+
+  enable_shared_from_this(enable_shared_from_this const&) noexcept {}
+
+  enable_shared_from_this& operator=(enable_shared_from_this const&) noexcept {
+    return *this;
+  }
+
+  ~enable_shared_from_this() = default;
+
+public:
+  // throws std::bad_weak_ptr if no shared_ptr owns the object
+  shared_ptr<T, Policy> shared_from_this() {
+    return checked_lock<T>();
+  }
+
+  shared_ptr<T const, Policy> shared_from_this() const {
+    return checked_lock<T const>();
+  }
+
+  weak_ptr<T, Policy> weak_from_this() noexcept {
+    return weak_this;
+  }
+
+  weak_ptr<T const, Policy> weak_from_this() const noexcept {
+    return weak_this;
+  }
+
+private:
+  template <typename U>
+  shared_ptr<U, Policy> checked_lock() const {
+    shared_ptr<U, Policy> result = weak_this.lock();
+    if (!result) {
+      throw std::bad_weak_ptr();
+    }
+    return result;
+  }
+};
+
+namespace shared_ptr_details {
+template <typename X, typename Policy, typename U>
+void access::link_shared_from_this(enable_shared_from_this<X, Policy> const* base,
+                                   control_block<Policy>* block,
+                                   U* ptr) noexcept {
+  if (base && !base->weak_this.lock()) {
+    auto* object = const_cast<std::remove_cv_t<U>*>(ptr);
+    base->weak_this = weak_ptr<X, Policy>(static_cast<X*>(object), block);
+  }
 }
+} // namespace shared_ptr_details
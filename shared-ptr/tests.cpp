@@ -310,6 +310,19 @@ TEST(shared_ptr_testing, allocations) {
   EXPECT_EQ(delete_calls_after - delete_calls_before, 2);
 }
 
+TEST(shared_ptr_testing, make_shared_array_allocations) {
+  size_t new_calls_before = new_calls;
+  size_t delete_calls_before = delete_calls;
+  {
+    shared_ptr<int[]> p = make_shared<int[]>(100);
+    EXPECT_EQ(0, p[99]);
+  }
+  const auto new_calls_after = new_calls;
+  const auto delete_calls_after = delete_calls;
+  EXPECT_EQ(new_calls_after - new_calls_before, 1);
+  EXPECT_EQ(delete_calls_after - delete_calls_before, 1);
+}
+
 TEST(shared_ptr_testing, make_shared_allocations) {
   size_t new_calls_before = new_calls;
   size_t delete_calls_before = delete_calls;
@@ -323,3 +336,24 @@ TEST(shared_ptr_testing, make_shared_allocations) {
   EXPECT_EQ(delete_calls_after - delete_calls_before, 1);
 }
 #endif
+
+TEST(shared_ptr_testing, array_conversions) {
+  static_assert(!std::is_convertible_v<shared_ptr<int>, shared_ptr<int[]>>);
+  static_assert(!std::is_convertible_v<shared_ptr<int[]>, shared_ptr<int[4]>>);
+  static_assert(!std::is_convertible_v<shared_ptr<int const[]>, shared_ptr<int[]>>);
+
+  shared_ptr<int[4]> fixed = make_shared<int[4]>();
+  fixed[3] = 7;
+  shared_ptr<int[]> unbounded = fixed;
+  shared_ptr<int const[]> const_unbounded = unbounded;
+  EXPECT_EQ(3, fixed.use_count());
+  EXPECT_EQ(7, const_unbounded[3]);
+
+  weak_ptr<int[]> w = fixed;
+  weak_ptr<int const[]> const_w = w;
+  const_w = unbounded;
+  EXPECT_EQ(7, const_w.lock()[3]);
+  const_w = w;
+  const_unbounded = fixed;
+  EXPECT_EQ(7, const_unbounded[3]);
+}
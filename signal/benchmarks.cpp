@@ -0,0 +1,189 @@
+#include "concurrent_signal.h"
+#include "signals.h"
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// signals::signal is single-threaded, so sharing it means one lock around
+// every emission, connect and disconnect
+struct locked_signal {
+  using signal_t = signals::signal<void(int)>;
+  using connection = signal_t::connection;
+
+  template <typename F>
+  connection connect(F slot) {
+    std::lock_guard<std::mutex> lock(m);
+    return sig.connect(std::move(slot));
+  }
+
+  void disconnect(connection& conn) {
+    std::lock_guard<std::mutex> lock(m);
+    conn.disconnect();
+  }
+
+  void emit(int value) {
+    std::lock_guard<std::mutex> lock(m);
+    sig(value);
+  }
+
+  std::mutex m;
+  signal_t sig;
+};
+
+struct lock_free_signal {
+  using signal_t = signals::concurrent_signal<void(int)>;
+  using connection = signal_t::connection;
+
+  template <typename F>
+  connection connect(F slot) {
+    return sig.connect(std::move(slot));
+  }
+
+  void disconnect(connection& conn) {
+    conn.disconnect();
+  }
+
+  void emit(int value) {
+    sig(value);
+  }
+
+  signal_t sig;
+};
+
+template <typename Signal>
+std::vector<typename Signal::connection> connect_slots(Signal& sig, size_t n) {
+  std::vector<typename Signal::connection> connections;
+  for (size_t i = 0; i < n; ++i) {
+    connections.push_back(
+        sig.connect([](int value) { benchmark::DoNotOptimize(value); }));
+  }
+  return connections;
+}
+
+template <typename Signal>
+void bm_emit(benchmark::State& state) {
+  Signal sig;
+  auto connections = connect_slots(sig, static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    sig.emit(42);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(bm_emit, locked_signal)->Arg(1)->Arg(16);
+BENCHMARK_TEMPLATE(bm_emit, lock_free_signal)->Arg(1)->Arg(16);
+
+// connecting and disconnecting one slot next to n others
+template <typename Signal>
+void bm_connect_disconnect(benchmark::State& state) {
+  Signal sig;
+  auto connections = connect_slots(sig, static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    auto conn = sig.connect([](int) {});
+    sig.disconnect(conn);
+  }
+}
+BENCHMARK_TEMPLATE(bm_connect_disconnect, locked_signal)->Arg(1)->Arg(16);
+BENCHMARK_TEMPLATE(bm_connect_disconnect, lock_free_signal)->Arg(1)->Arg(16);
+
+// a capture of four words, more than std::function keeps inline
+struct capture {
+  int* target;
+  size_t a, b, c;
+};
+
+template <typename Signal>
+void bm_connect_capturing(benchmark::State& state) {
+  Signal sig;
+  int sum = 0;
+  capture cap{&sum, 1, 2, 3};
+  for (auto _ : state) {
+    auto conn = sig.connect([cap](int value) { *cap.target += value; });
+    sig.disconnect(conn);
+  }
+}
+BENCHMARK_TEMPLATE(bm_connect_capturing, locked_signal);
+BENCHMARK_TEMPLATE(bm_connect_capturing, lock_free_signal);
+
+template <typename Signal>
+void bm_emit_capturing(benchmark::State& state) {
+  Signal sig;
+  int sum = 0;
+  std::vector<typename Signal::connection> connections;
+  for (size_t i = 0; i < 16; ++i) {
+    capture cap{&sum, i, i, i};
+    connections.push_back(sig.connect(
+        [cap](int value) { *cap.target += value + static_cast<int>(cap.a); }));
+  }
+  for (auto _ : state) {
+    sig.emit(1);
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(bm_emit_capturing, locked_signal);
+BENCHMARK_TEMPLATE(bm_emit_capturing, lock_free_signal);
+
+// the first slot recurses to the given depth and there replaces all 64
+// other subscribers, so every disconnect happens under that many emissions
+void bm_disconnect_in_deep_emit(benchmark::State& state) {
+  using signal_t = signals::signal<void(int)>;
+  constexpr size_t SUBSCRIBERS = 64;
+
+  signal_t sig;
+  std::vector<signal_t::connection> subscribers(SUBSCRIBERS);
+  auto recurse = sig.connect([&](int depth) {
+    if (depth != 0) {
+      sig(depth - 1);
+      return;
+    }
+    for (auto& conn : subscribers) {
+      conn = sig.connect([](int value) { benchmark::DoNotOptimize(value); });
+    }
+  });
+
+  auto depth = static_cast<int>(state.range(0));
+  for (auto _ : state) {
+    sig(depth);
+  }
+  state.SetItemsProcessed(state.iterations() * SUBSCRIBERS);
+}
+BENCHMARK(bm_disconnect_in_deep_emit)->Arg(1)->Arg(16)->Arg(64);
+
+// all threads emit one signal with 16 subscribers while thread 0 also
+// connects and disconnects a subscriber every 1024 emissions
+template <typename Signal>
+void bm_emit_concurrent(benchmark::State& state) {
+  static std::unique_ptr<Signal> sig;
+  static std::vector<typename Signal::connection> connections;
+  if (state.thread_index() == 0) {
+    sig = std::make_unique<Signal>();
+    connections = connect_slots(*sig, 16);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    if (state.thread_index() == 0 && ++i % 1024 == 0) {
+      auto conn = sig->connect([](int) {});
+      sig->disconnect(conn);
+    }
+    sig->emit(42);
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    connections.clear();
+    sig.reset();
+  }
+}
+BENCHMARK_TEMPLATE(bm_emit_concurrent, locked_signal)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(bm_emit_concurrent, lock_free_signal)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+} // namespace
@@ -0,0 +1,259 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace signals {
+
+template <typename T>
+struct concurrent_signal;
+
+// a signal that any number of threads may emit, connect to and disconnect
+// from at the same time.
+//
+// Emission doesn't lock: the slots live in an immutable snapshot, and the
+// signal is a single word packing the snapshot address (upper 48 bits) with
+// a count of emissions that pinned it (lower 16 bits). An emission pins the
+// snapshot with one fetch_add, calls the slots and unpins it. Connect and
+// disconnect serialize on a mutex, publish a modified copy and turn the
+// pins counted in the old word into references on the old snapshot, so it
+// is freed by whoever finishes with it last.
+//
+// An emission calls the slots connected when it started, skipping those
+// disconnected since; a callback may still be running when disconnect()
+// returns on another thread. The signal must outlive its use on every
+// thread, callbacks included.
+template <typename... Args>
+struct concurrent_signal<void(Args...)> {
+  using callback_t = std::function<void(Args...)>;
+
+private:
+  struct slot {
+    slot(concurrent_signal* sig, callback_t&& callback)
+        : callback(std::move(callback)), sig(sig) {}
+
+    callback_t const callback;
+    std::atomic<bool> connected{true};
+    // cleared by the signal's destructor
+    std::atomic<concurrent_signal*> sig;
+  };
+
+  // the slot list emissions walk; a writer never changes one once it is
+  // published, it publishes a changed copy instead
+  struct snapshot {
+    // one for the word while the snapshot is published, plus one for every
+    // emission still walking it after a writer replaced it
+    std::atomic<size_t> refs{1};
+    std::vector<std::shared_ptr<slot>> slots;
+  };
+
+  // the word is the published snapshot's address shifted up, with the
+  // emissions that pinned it through the word counted in the low bits
+  static constexpr unsigned EMISSION_BITS = 16;
+  static constexpr uintptr_t EMISSION_MASK =
+      (uintptr_t(1) << EMISSION_BITS) - 1;
+
+  static_assert(sizeof(uintptr_t) == 8,
+                "a snapshot address has to fit the word above the emission "
+                "count");
+
+  static snapshot* snapshot_of(uintptr_t w) noexcept {
+    return reinterpret_cast<snapshot*>(w >> EMISSION_BITS);
+  }
+
+  static uintptr_t emissions_in(uintptr_t w) noexcept {
+    return w & EMISSION_MASK;
+  }
+
+  static uintptr_t word_for(snapshot* s) noexcept {
+    auto address = reinterpret_cast<uintptr_t>(s);
+    assert((address >> (64 - EMISSION_BITS)) == 0);
+    return address << EMISSION_BITS;
+  }
+
+  // the last reference frees the snapshot and with it the slots only it
+  // still held, so a disconnected callback is destroyed by whichever thread
+  // finishes with it last
+  static void unref(snapshot* s) noexcept {
+    if (s && s->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete s;
+    }
+  }
+
+  // the acquire pairs with the writer that published the snapshot, so the
+  // emission sees the slots it was published with
+  snapshot* pin() const noexcept {
+    return snapshot_of(word.fetch_add(1, std::memory_order_acquire) + 1);
+  }
+
+  // takes the emission off the word; if a writer has replaced the snapshot
+  // meanwhile, it turned the emission's share of the word into a reference,
+  // which is dropped instead. A signal without slots publishes null and
+  // writers discard the count on it, so there it only must not go below
+  // zero.
+  void unpin(snapshot* s) const noexcept {
+    uintptr_t cur = word.load(std::memory_order_relaxed);
+    while (snapshot_of(cur) == s) {
+      if (!s && emissions_in(cur) == 0) {
+        return;
+      }
+      if (word.compare_exchange_weak(cur, cur - 1, std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    unref(s);
+  }
+
+  // a writer has swapped old out of the word: every emission counted in it
+  // gets a reference of its own before the word's reference goes, so the
+  // snapshot can't be freed under an emission that hasn't unpinned yet
+  static void retire(uintptr_t old) noexcept {
+    snapshot* s = snapshot_of(old);
+    if (!s) {
+      return;
+    }
+    uintptr_t pinned = emissions_in(old);
+    if (pinned != 0) {
+      s->refs.fetch_add(pinned, std::memory_order_relaxed);
+    }
+    unref(s);
+  }
+
+  // keeps the snapshot an emission walks alive until the emission ends
+  struct emission {
+    explicit emission(concurrent_signal const* sig) noexcept
+        : sig(sig), current(sig->pin()) {}
+
+    ~emission() {
+      sig->unpin(current);
+    }
+
+    concurrent_signal const* sig;
+    snapshot* current;
+  };
+
+  // the rest is only called with the mutex held: writers are the only ones
+  // that replace the snapshot, so they read it without pinning it
+  snapshot* published() const noexcept {
+    return snapshot_of(word.load(std::memory_order_acquire));
+  }
+
+  void publish(snapshot* next) noexcept {
+    retire(word.exchange(word_for(next), std::memory_order_acq_rel));
+  }
+
+  // a copy of the published slots without the disconnected ones, plus
+  // extra if given; an empty list is published as no snapshot at all
+  void republish(std::shared_ptr<slot> extra) {
+    snapshot* cur = published();
+    auto next = std::make_unique<snapshot>();
+    if (cur) {
+      next->slots.reserve(cur->slots.size() + 1);
+      for (auto const& s : cur->slots) {
+        if (s->connected.load(std::memory_order_relaxed)) {
+          next->slots.push_back(s);
+        }
+      }
+    }
+    if (extra) {
+      next->slots.push_back(std::move(extra));
+    }
+    publish(next->slots.empty() ? nullptr : next.release());
+  }
+
+  void drop_disconnected() noexcept {
+    std::lock_guard<std::mutex> lock(m);
+    try {
+      republish(nullptr);
+    } catch (...) {
+      // the slot is already marked, so emissions skip it and the next
+      // successful update drops it
+    }
+  }
+
+public:
+  struct connection {
+    connection() noexcept = default;
+
+    connection(connection&& other) noexcept = default;
+
+    connection& operator=(connection&& other) noexcept {
+      if (&other == this) {
+        return *this;
+      }
+      disconnect();
+      target = std::move(other.target);
+      return *this;
+    }
+
+    void disconnect() noexcept {
+      if (!target) {
+        return;
+      }
+      target->connected.store(false, std::memory_order_release);
+      if (auto* sig = target->sig.load(std::memory_order_acquire)) {
+        sig->drop_disconnected();
+      }
+      target.reset();
+    }
+
+    ~connection() {
+      disconnect();
+    }
+
+  private:
+    explicit connection(std::shared_ptr<slot> target) noexcept
+        : target(std::move(target)) {}
+
+    std::shared_ptr<slot> target;
+
+    friend struct concurrent_signal;
+  };
+
+  concurrent_signal() noexcept = default;
+
+  concurrent_signal(concurrent_signal const&) = delete;
+  concurrent_signal& operator=(concurrent_signal const&) = delete;
+
+  // tells the slots the signal is gone, so connections outliving it don't
+  // reach back into it, then publishes null to drop the last snapshot
+  ~concurrent_signal() {
+    std::lock_guard<std::mutex> lock(m);
+    if (snapshot* cur = published()) {
+      for (auto const& s : cur->slots) {
+        s->sig.store(nullptr, std::memory_order_release);
+      }
+    }
+    publish(nullptr);
+  }
+
+  connection connect(callback_t callback) {
+    auto target = std::make_shared<slot>(this, std::move(callback));
+    std::lock_guard<std::mutex> lock(m);
+    republish(target);
+    return connection(std::move(target));
+  }
+
+  void operator()(Args... args) const {
+    emission e(this);
+    if (!e.current) {
+      return;
+    }
+    for (auto const& s : e.current->slots) {
+      if (s->connected.load(std::memory_order_acquire)) {
+        s->callback(args...);
+      }
+    }
+  }
+
+private:
+  mutable std::atomic<uintptr_t> word{0};
+  std::mutex m;
+};
+
+} // namespace signals
@@ -0,0 +1,235 @@
+#include "concurrent_signal.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using void_signal = signals::concurrent_signal<void()>;
+
+TEST(concurrent_signal_testing, trivial) {
+  void_signal sig;
+  uint32_t got1 = 0;
+  auto conn1 = sig.connect([&] { ++got1; });
+  uint32_t got2 = 0;
+  auto conn2 = sig.connect([&] { ++got2; });
+
+  sig();
+
+  EXPECT_EQ(1, got1);
+  EXPECT_EQ(1, got2);
+
+  sig();
+
+  EXPECT_EQ(2, got1);
+  EXPECT_EQ(2, got2);
+}
+
+TEST(concurrent_signal_testing, arguments) {
+  signals::concurrent_signal<void(int, int, int)> sig;
+  auto conn = sig.connect([](int a, int b, int c) {
+    EXPECT_EQ(5, a);
+    EXPECT_EQ(6, b);
+    EXPECT_EQ(7, c);
+  });
+
+  sig(5, 6, 7);
+}
+
+TEST(concurrent_signal_testing, empty_signal) {
+  void_signal sig;
+  sig();
+  auto conn = sig.connect([] {});
+  conn.disconnect();
+  sig();
+}
+
+TEST(concurrent_signal_testing, disconnect) {
+  void_signal sig;
+  uint32_t got1 = 0;
+  auto conn1 = sig.connect([&] { ++got1; });
+  uint32_t got2 = 0;
+  auto conn2 = sig.connect([&] { ++got2; });
+
+  sig();
+  conn1.disconnect();
+  sig();
+
+  EXPECT_EQ(1, got1);
+  EXPECT_EQ(2, got2);
+}
+
+TEST(concurrent_signal_testing, connection_move) {
+  void_signal sig;
+  uint32_t got = 0;
+  auto conn_old = sig.connect([&] { ++got; });
+  auto conn_new = std::move(conn_old);
+  sig();
+  EXPECT_EQ(1, got);
+
+  void_signal::connection other;
+  other = std::move(conn_new);
+  sig();
+  EXPECT_EQ(2, got);
+
+  other = void_signal::connection();
+  sig();
+  EXPECT_EQ(2, got);
+}
+
+TEST(concurrent_signal_testing, destroy_signal_before_connection) {
+  auto sig = std::make_unique<void_signal>();
+  auto conn = sig->connect([] {});
+  sig.reset();
+  conn.disconnect();
+}
+
+TEST(concurrent_signal_testing, disconnect_in_emit) {
+  void_signal sig;
+  uint32_t got2 = 0;
+  void_signal::connection conn2;
+  auto conn1 = sig.connect([&] { conn2.disconnect(); });
+  conn2 = sig.connect([&] { ++got2; });
+
+  sig();
+  EXPECT_EQ(0, got2);
+}
+
+TEST(concurrent_signal_testing, connect_in_emit) {
+  void_signal sig;
+  uint32_t got2 = 0;
+  bool connected = false;
+  void_signal::connection conn2;
+  auto conn1 = sig.connect([&] {
+    if (!connected) {
+      conn2 = sig.connect([&] { ++got2; });
+      connected = true;
+    }
+  });
+
+  sig();
+  EXPECT_EQ(0, got2);
+  sig();
+  EXPECT_EQ(1, got2);
+}
+
+TEST(concurrent_signal_testing, recursive_emit) {
+  signals::concurrent_signal<void(int)> sig;
+  uint32_t got = 0;
+  auto conn = sig.connect([&](int depth) {
+    ++got;
+    if (depth != 0) {
+      sig(depth - 1);
+    }
+  });
+
+  sig(3);
+  EXPECT_EQ(4, got);
+}
+
+TEST(concurrent_signal_testing, exception_in_emit) {
+  void_signal sig;
+  auto conn1 = sig.connect([] { throw std::runtime_error("slot"); });
+  EXPECT_THROW(sig(), std::runtime_error);
+
+  conn1.disconnect();
+  uint32_t got = 0;
+  auto conn2 = sig.connect([&] { ++got; });
+  sig();
+  EXPECT_EQ(1, got);
+}
+
+namespace {
+struct owned_state {
+  explicit owned_state(std::atomic<size_t>& destroyed)
+      : destroyed(destroyed) {}
+
+  ~owned_state() {
+    alive.store(false);
+    destroyed.fetch_add(1);
+  }
+
+  std::atomic<bool> alive{true};
+  std::atomic<size_t>& destroyed;
+};
+} // namespace
+
+// a connection is disconnected while another thread emits; the callback's
+// captured state goes with the callback on whichever thread drops it last,
+// never while a call is still running
+TEST(concurrent_signal_testing, disconnect_while_other_thread_emits) {
+  constexpr size_t ROUNDS = 200;
+
+  void_signal sig;
+  std::atomic<size_t> destroyed{0};
+  std::atomic<bool> stale{false};
+  for (size_t round = 0; round < ROUNDS; ++round) {
+    std::atomic<size_t> calls{0};
+    auto conn = sig.connect(
+        [state = std::make_shared<owned_state>(destroyed), &calls, &stale] {
+          if (!state->alive.load()) {
+            stale.store(true);
+          }
+          calls.fetch_add(1);
+        });
+
+    std::atomic<bool> done{false};
+    std::thread emitter([&] {
+      while (!done.load()) {
+        sig();
+      }
+    });
+    while (calls.load() == 0) {
+      std::this_thread::yield();
+    }
+    conn.disconnect();
+    done.store(true);
+    emitter.join();
+    EXPECT_EQ(round + 1, destroyed.load());
+  }
+  EXPECT_FALSE(stale.load());
+}
+
+// emitters run while other threads keep connecting and disconnecting; a
+// slot that stays connected throughout sees every emission
+TEST(concurrent_signal_testing, emit_during_updates) {
+  constexpr size_t EMITTERS = 4;
+  constexpr size_t WRITERS = 2;
+  constexpr size_t EMISSIONS = 20000;
+
+  signals::concurrent_signal<void(int)> sig;
+  std::atomic<size_t> steady{0};
+  auto conn = sig.connect([&](int) { steady.fetch_add(1); });
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> writers;
+  for (size_t i = 0; i < WRITERS; ++i) {
+    writers.emplace_back([&] {
+      std::atomic<size_t> calls{0};
+      while (!done.load()) {
+        auto temporary = sig.connect([&](int) { calls.fetch_add(1); });
+        temporary.disconnect();
+      }
+    });
+  }
+
+  std::vector<std::thread> emitters;
+  for (size_t i = 0; i < EMITTERS; ++i) {
+    emitters.emplace_back([&] {
+      for (size_t j = 0; j < EMISSIONS; ++j) {
+        sig(static_cast<int>(j));
+      }
+    });
+  }
+  for (auto& t : emitters) {
+    t.join();
+  }
+  done.store(true);
+  for (auto& t : writers) {
+    t.join();
+  }
+
+  EXPECT_EQ(EMITTERS * EMISSIONS, steady.load());
+}
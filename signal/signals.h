@@ -1,134 +1,303 @@
 #pragma once
 #include "intrusive_list.h"
 #include <functional>
+#include <new>
+#include <optional>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 
 // Чтобы не было коллизий с UNIX-сигналами реализация вынесена в неймспейс, по
 // той же причине изменено и название файла
 namespace signals {
 
-template <typename T>
+// callables of up to InlineSize bytes are kept in the connection itself, so
+// connecting them doesn't allocate
+template <typename T, size_t InlineSize = 4 * sizeof(void*)>
 struct signal;
 
-template <typename... Args>
-struct signal<void(Args...)> {
+template <size_t InlineSize, typename... Args>
+struct signal<void(Args...), InlineSize> {
   using callback_t = std::function<void(Args...)>;
-  struct connection_tag;
 
-  struct connection : intrusive::list_element<connection_tag> {
-    connection() noexcept : sig(nullptr){};
+private:
+  struct node_tag;
+
+  struct callable_ops {
+    void (*invoke)(void* buffer, Args&... args);
+    void (*move)(void* dst, void* src) noexcept;
+    void (*destroy)(void* buffer) noexcept;
+  };
+
+  using buffer_t = std::aligned_storage_t<InlineSize, alignof(void*)>;
+
+  template <typename F>
+  static constexpr bool fits_inline =
+      sizeof(F) <= sizeof(buffer_t) && alignof(F) <= alignof(buffer_t) &&
+      std::is_nothrow_move_constructible_v<F>;
+
+  template <typename F>
+  struct inline_callable {
+    static F& get(void* buffer) noexcept {
+      return *std::launder(reinterpret_cast<F*>(buffer));
+    }
+
+    static void create(void* buffer, F&& callback) noexcept {
+      new (buffer) F(std::move(callback));
+    }
+
+    static void invoke(void* buffer, Args&... args) {
+      get(buffer)(args...);
+    }
+
+    static void move(void* dst, void* src) noexcept {
+      new (dst) F(std::move(get(src)));
+      get(src).~F();
+    }
+
+    static void destroy(void* buffer) noexcept {
+      get(buffer).~F();
+    }
+
+    static constexpr callable_ops ops = {&invoke, &move, &destroy};
+  };
+
+  // the rest live on the heap, the buffer holding the pointer
+  template <typename F>
+  struct heap_callable {
+    static F*& get(void* buffer) noexcept {
+      return *std::launder(reinterpret_cast<F**>(buffer));
+    }
+
+    static void create(void* buffer, F&& callback) {
+      new (buffer) F*(new F(std::move(callback)));
+    }
+
+    static void invoke(void* buffer, Args&... args) {
+      (*get(buffer))(args...);
+    }
+
+    static void move(void* dst, void* src) noexcept {
+      new (dst) F*(get(src));
+    }
+
+    static void destroy(void* buffer) noexcept {
+      delete get(buffer);
+    }
+
+    static constexpr callable_ops ops = {&invoke, &move, &destroy};
+  };
+
+  template <typename F>
+  using callable = std::conditional_t<fits_inline<F>, inline_callable<F>,
+                                      heap_callable<F>>;
+
+  struct invocation;
+
+  // emissions hold no pointers into the list while a callback runs, except
+  // to the slot being called, so any other slot leaves the list at once,
+  // in O(1) however many emissions are running. A slot whose callback is
+  // running stays in place, marked dead if it is disconnected; if its
+  // connection is destroyed or moved, the call's stand-in takes its place.
+  struct node : intrusive::list_element<node_tag> {
+    node() noexcept = default;
+    node(node const&) = delete;
+
+    // null for a stand-in
+    callable_ops const* ops = nullptr;
+    // the outermost running call of the slot
+    invocation* running = nullptr;
+    bool dead = false;
+  };
+
+  struct slot : node {
+    buffer_t buffer;
+  };
 
-    connection(signal* sig, callback_t&& callback)
-        : callback(std::move(callback)), sig(sig) {
-      if (sig != nullptr) {
-        sig->callbacks.push_back(*this);
+  using node_list = intrusive::list<node, node_tag>;
+
+  // unlinks a slot no call refers to and destroys its callable
+  static void release(node& target) noexcept {
+    if (target.in_list()) {
+      target.unlink();
+    }
+    target.dead = false;
+    if (target.ops) {
+      std::exchange(target.ops, nullptr)
+          ->destroy(&static_cast<slot&>(target).buffer);
+    }
+  }
+
+  // the outermost emission owns the flag the destructor raises, nested ones
+  // share it
+  struct emission {
+    explicit emission(signal const* sig) noexcept
+        : sig(sig), outermost(sig->destroyed == nullptr) {
+      if (outermost) {
+        sig->destroyed = &flag;
       }
+      destroyed = sig->destroyed;
+    }
+
+    ~emission() {
+      if (outermost && !flag) {
+        sig->destroyed = nullptr;
+      }
+    }
+
+    signal const* sig;
+    bool const outermost;
+    bool flag = false;
+    bool* destroyed;
+  };
+
+  // the outermost call of a slot; nested calls of the same slot find it
+  // through the slot. It knows where the slot is, and removes the slot
+  // when the call ends and the slot is dead.
+  struct invocation {
+    explicit invocation(node& target) noexcept : current(&target) {
+      target.running = this;
     }
 
-    connection(connection&& other) : connection() {
-      own_other_members(std::move(other));
+    ~invocation() {
+      // null once the signal is destroyed
+      if (!current) {
+        return;
+      }
+      current->running = nullptr;
+      if (current->dead) {
+        release(*current);
+      }
     }
 
-    connection& operator=(connection&& other) {
+    node* current;
+    // only made when the connection goes away during the call
+    std::optional<node> stand_in;
+  };
+
+public:
+  struct connection {
+    connection() noexcept = default;
+
+    connection(connection&& other) noexcept {
+      take(other);
+    }
+
+    connection& operator=(connection&& other) noexcept {
       if (&other == this) {
         return *this;
       }
-      disconnect();
-      own_other_members(std::move(other));
+      vacate();
+      take(other);
       return *this;
     }
 
     void disconnect() noexcept {
-      if (!sig) {
+      if (target.in_list() && target.running) {
+        target.dead = true;
         return;
       }
-      for (auto cur = sig->tail; cur != nullptr; cur = cur->next) {
-        if (cur->it != sig->callbacks.end() && &(*cur->it) == this) {
-          ++cur->it;
-        }
-      }
-      this->unlink();
-      callback = {};
-      sig = nullptr;
+      release(target);
     }
 
     ~connection() {
-      disconnect();
+      vacate();
     }
 
   private:
-    void own_other_members(connection&& other) {
-      callback = std::move(other.callback);
-      if (other.sig == nullptr) {
-        sig = nullptr;
-        return;
-      }
-      auto it = other.sig->callbacks.as_iterator(other);
-      other.sig->callbacks.insert(++it, *this);
-      sig = other.sig;
-      other.disconnect();
+    template <typename F>
+    connection(node_list& slots, F&& callback) {
+      callable<F>::create(&target.buffer, std::move(callback));
+      target.ops = &callable<F>::ops;
+      slots.push_back(target);
     }
 
-    callback_t callback;
-    signal* sig;
-
-    friend struct signal;
-  };
-
-  struct iteration_token {
-    iteration_token(signal const* sig)
-        : it(sig->callbacks.begin()), next(sig->tail), sig(sig) {
-      sig->tail = this;
+    // frees the slot's memory; a running call gets its stand-in in the
+    // slot's place
+    void vacate() noexcept {
+      if (target.in_list() && target.running) {
+        invocation* call = target.running;
+        node& stand_in = call->stand_in.emplace();
+        stand_in.dead = true;
+        stand_in.running = call;
+        stand_in.insert_before(&target);
+        call->current = &stand_in;
+        target.running = nullptr;
+      }
+      release(target);
     }
 
-    ~iteration_token() {
-      if (sig) {
-        sig->tail = next;
+    // the slot goes right before the other one, so emissions that are
+    // calling the other one don't call it again
+    void take(connection& other) noexcept {
+      if (other.target.in_list() && !other.target.dead) {
+        other.target.ops->move(&target.buffer, &other.target.buffer);
+        target.ops = std::exchange(other.target.ops, nullptr);
+        target.insert_before(&other.target);
       }
+      other.vacate();
     }
 
-  private:
+    slot target;
+
     friend struct signal;
-    typename intrusive::list<connection, connection_tag>::const_iterator it;
-    iteration_token* next;
-    signal const* sig = nullptr;
   };
 
-  signal() noexcept
-      : callbacks(intrusive::list<connection, connection_tag>()),
-        tail(nullptr) {}
+  signal() noexcept = default;
 
   signal(signal const&) = delete;
   signal& operator=(signal const&) = delete;
 
-  connection connect(callback_t slot) noexcept {
-    return connection(this, std::move(slot));
+  template <typename F>
+  connection connect(F callback) {
+    static_assert(std::is_invocable_v<F&, Args&...>,
+                  "the callback can't be called with the signal's arguments");
+    return connection(slots, std::move(callback));
   }
 
   ~signal() {
-    for (iteration_token* token = tail; token != nullptr; token = token->next) {
-      token->sig = nullptr;
+    if (destroyed) {
+      *destroyed = true;
     }
-    while (!callbacks.empty()) {
-      callbacks.back().disconnect();
+    while (!slots.empty()) {
+      node& cur = slots.front();
+      if (cur.running) {
+        cur.running->current = nullptr;
+        cur.running = nullptr;
+      }
+      release(cur);
     }
   }
 
   void operator()(Args... args) const {
-    iteration_token token(this);
-    while (token.sig && token.it != callbacks.end()) {
-      auto cur = token.it;
-      ++token.it;
-      cur->callback(args...);
-      if (token.sig == nullptr) {
+    emission token(this);
+    for (auto it = slots.begin(); it != slots.end();) {
+      if (it->dead) {
+        ++it;
+        continue;
+      }
+      auto& cur = static_cast<slot&>(*it);
+      if (invocation* outer = cur.running) {
+        cur.ops->invoke(&cur.buffer, args...);
+        if (*token.destroyed) {
+          return;
+        }
+        it = std::next(slots.as_iterator(*outer->current));
+        continue;
+      }
+      invocation call(cur);
+      cur.ops->invoke(&cur.buffer, args...);
+      if (*token.destroyed) {
         return;
       }
+      it = std::next(slots.as_iterator(*call.current));
     }
   }
 
 private:
-  intrusive::list<connection, connection_tag> callbacks;
-  mutable iteration_token* tail;
+  mutable node_list slots;
+  // set while an emission runs
+  mutable bool* destroyed = nullptr;
 };
 
 } // namespace signals
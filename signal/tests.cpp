@@ -1,6 +1,11 @@
 #include "signals.h"
 #include "gtest/gtest.h"
 
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
 TEST(signal_testing, trivial) {
   signals::signal<void()> sig;
   uint32_t got1 = 0;
@@ -254,6 +259,184 @@ TEST(signal_testing, move_in_emit_02) {
   EXPECT_EQ(1, got1);
 }
 
+TEST(signal_testing, disconnect_in_recursive_emit) {
+  using connection = signals::signal<void(int)>::connection;
+
+  signals::signal<void(int)> sig;
+  uint32_t got2 = 0;
+  std::unique_ptr<connection> conn2;
+  connection conn1 = sig.connect([&](int depth) {
+    if (depth != 0) {
+      sig(depth - 1);
+    } else {
+      conn2.reset();
+    }
+  });
+  conn2 = std::make_unique<connection>(sig.connect([&](int) { ++got2; }));
+  uint32_t got3 = 0;
+  connection conn3 = sig.connect([&](int) { ++got3; });
+
+  sig(3);
+  EXPECT_EQ(0, got2);
+  EXPECT_EQ(4, got3);
+
+  sig(0);
+  EXPECT_EQ(0, got2);
+  EXPECT_EQ(5, got3);
+}
+
+TEST(signal_testing, destroy_signal_with_disconnected_in_emit) {
+  using connection = signals::signal<void()>::connection;
+
+  auto sig = std::make_unique<signals::signal<void()>>();
+  connection conn2;
+  connection conn1 = sig->connect([&] {
+    conn2.disconnect();
+    sig.reset();
+  });
+  conn2 = sig->connect([] {});
+
+  (*sig)();
+  EXPECT_EQ(nullptr, sig);
+}
+
+TEST(signal_testing, stateful_callbacks) {
+  signals::signal<void(int)> sig;
+  int last_total = 0;
+  auto conn1 = sig.connect([&last_total, total = 0](int value) mutable {
+    total += value;
+    last_total = total;
+  });
+  std::array<int, 16> weights{};
+  weights.fill(2);
+  int weighted = 0;
+  auto conn2 = sig.connect(
+      [&weighted, weights](int value) { weighted += weights[0] * value; });
+  int sum = 0;
+  std::function<void(int)> wrapped = [&sum](int value) { sum += value; };
+  auto conn3 = sig.connect(wrapped);
+
+  sig(1);
+  sig(2);
+
+  EXPECT_EQ(3, last_total);
+  EXPECT_EQ(3, sum);
+  EXPECT_EQ(6, weighted);
+}
+
+TEST(signal_testing, callbacks_released_once) {
+  using connection = signals::signal<void()>::connection;
+
+  auto alive = std::make_shared<int>();
+  auto sig = std::make_unique<signals::signal<void()>>();
+  connection conn2;
+  connection conn1 = sig->connect([&] { conn2.disconnect(); });
+  conn2 = sig->connect([alive] {});
+  connection conn3 = sig->connect([alive] {});
+  EXPECT_EQ(3, alive.use_count());
+
+  (*sig)();
+  EXPECT_EQ(2, alive.use_count());
+
+  sig.reset();
+  EXPECT_EQ(1, alive.use_count());
+  conn3.disconnect();
+  EXPECT_EQ(1, alive.use_count());
+}
+
+namespace {
+// remembers where it was called, to tell inline callables from heap ones
+struct located_callback {
+  void operator()() const {
+    *where = this;
+  }
+
+  void const** where;
+  char padding[16];
+};
+
+template <typename Connection>
+bool stored_in(Connection const& conn, void const* where) {
+  auto* first = reinterpret_cast<char const*>(&conn);
+  auto* p = static_cast<char const*>(where);
+  return p >= first && p < first + sizeof(Connection);
+}
+} // namespace
+
+TEST(signal_testing, small_callbacks_inline) {
+  signals::signal<void()> sig;
+  void const* where = nullptr;
+  auto conn = sig.connect(located_callback{&where, {}});
+  sig();
+  EXPECT_TRUE(stored_in(conn, where));
+
+  auto moved = std::move(conn);
+  sig();
+  EXPECT_TRUE(stored_in(moved, where));
+}
+
+TEST(signal_testing, large_callbacks) {
+  std::array<char, 256> big{};
+  big[255] = 1;
+  int got = 0;
+
+  signals::signal<void()> sig;
+  auto conn = sig.connect([&got, big] { got += big[255]; });
+  signals::signal<void(), 512> roomy;
+  void const* where = nullptr;
+  auto roomy_conn = roomy.connect([&got, big] { got += big[255]; });
+  auto located = roomy.connect(located_callback{&where, {}});
+
+  sig();
+  roomy();
+  EXPECT_EQ(2, got);
+  EXPECT_TRUE(stored_in(located, where));
+}
+
+TEST(signal_testing, connections_moved_in_emit) {
+  using connection = signals::signal<void()>::connection;
+
+  signals::signal<void()> sig;
+  std::array<uint32_t, 4> got{};
+  uint32_t added = 0;
+  std::vector<connection> conns;
+  conns.reserve(4);
+  conns.push_back(sig.connect([&] {
+    ++got[0];
+    // reallocates, moving every connection, the running one too
+    conns.push_back(sig.connect([&] { ++added; }));
+  }));
+  for (size_t i = 1; i < 4; ++i) {
+    conns.push_back(sig.connect([&got, i] { ++got[i]; }));
+  }
+
+  sig();
+  EXPECT_EQ((std::array<uint32_t, 4>{1, 1, 1, 1}), got);
+  EXPECT_EQ(1, added);
+}
+
+TEST(signal_testing, destroy_connection_in_recursive_emit) {
+  using connection = signals::signal<void(int)>::connection;
+
+  signals::signal<void(int)> sig;
+  auto conn1 = std::make_unique<connection>();
+  *conn1 = sig.connect([&](int depth) {
+    if (depth != 0) {
+      sig(depth - 1);
+    } else {
+      conn1.reset();
+    }
+  });
+  uint32_t got2 = 0;
+  connection conn2 = sig.connect([&](int) { ++got2; });
+
+  sig(2);
+  EXPECT_EQ(3, got2);
+
+  sig(2);
+  EXPECT_EQ(4, got2);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();